@@ -120,6 +120,9 @@ int Application::run()
 		//fail();
 	}
 
+	// Key distribution over the nodes still alive
+	reportLoad();
+
 	// Clean up
 	en->ENcleanup();
 	en1->ENcleanup();
@@ -486,7 +489,7 @@ void Application::readTest() {
 	// This key is used for all read tests
 	map<string, string>::iterator it = testKVPairs.begin();
 	int number;
-	vector<Node> replicas;
+	ReplicaSet replicas;
 	int replicaIdToFail = TERTIARY;
 	int nodeToFail;
 	bool failedOneNode = false;
@@ -517,7 +520,7 @@ void Application::readTest() {
 		replicas.clear();
 		replicas = mp2[number]->findNodes(it->first);
 		// if less than quorum replicas are found then exit
-		if ( replicas.size() < (RF-1) ) {
+		if ( replicas.size() < (par->REPLICATION_FACTOR-1) ) {
 			cout<<endl<<"Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: "<<replicas.size()<<endl;
 			log->LOG(&mp2[number]->getMemberNode()->addr, "Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: %d", replicas.size());
 			exit(1);
@@ -731,7 +734,7 @@ void Application::updateTest() {
 	it++;
 	string newValue = "newValue";
 	int number;
-	vector<Node> replicas;
+	ReplicaSet replicas;
 	int replicaIdToFail = TERTIARY;
 	int nodeToFail;
 	bool failedOneNode = false;
@@ -762,7 +765,7 @@ void Application::updateTest() {
 		replicas.clear();
 		replicas = mp2[number]->findNodes(it->first);
 		// if quorum replicas are not found then exit
-		if ( replicas.size() < RF-1 ) {
+		if ( replicas.size() < par->REPLICATION_FACTOR-1 ) {
 			log->LOG(&mp2[number]->getMemberNode()->addr, "Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: %d", replicas.size());
 			cout<<endl<<"Could not find at least quorum replicas for this key. Exiting!!! size of replicas vector: "<<replicas.size()<<endl;
 			exit(1);
@@ -962,3 +965,36 @@ void Application::updateTest() {
 	/** end of test 5 **/
 
 }
+
+/**
+ * FUNCTION NAME: reportLoad
+ *
+ * DESCRIPTION: Write the number of keys and bytes stored at every live node and the variance
+ * 				of the key counts to the stats log
+ */
+void Application::reportLoad() {
+	vector<unsigned long> counts;
+	double mean = 0, variance = 0;
+	for ( int i = 0; i < par->EN_GPSZ; i++ ) {
+		if ( !mp2[i]->getMemberNode()->bFailed ) {
+			counts.push_back(mp2[i]->keyCount());
+			mean += counts.back();
+			size_t bytes = mp2[i]->storeBytes();
+			log->LOG(&mp2[i]->getMemberNode()->addr, "#STATSLOG# keys stored: %lu, %zu bytes, %.1f bytes/key",
+				counts.back(), bytes, counts.back() ? (double)bytes / counts.back() : 0.0);
+		}
+	}
+	if ( counts.empty() ) {
+		return;
+	}
+	mean /= counts.size();
+	for ( unsigned long c : counts ) {
+		variance += (c - mean) * (c - mean);
+	}
+	variance /= counts.size();
+	unsigned long minKeys = *min_element(counts.begin(), counts.end());
+	unsigned long maxKeys = *max_element(counts.begin(), counts.end());
+	log->LOG(&mp2[0]->getMemberNode()->addr, "#STATSLOG# load over %d nodes with %d tokens each: mean %.2f keys, variance %.2f, stddev %.2f, min %lu, max %lu",
+		(int)counts.size(), par->VNODES, mean, variance, sqrt(variance), minKeys, maxKeys);
+	cout<<endl<<"Keys per node: mean "<<mean<<" variance "<<variance<<" min "<<minKeys<<" max "<<maxKeys<<endl;
+}
@@ -0,0 +1,85 @@
+/**********************************
+ * FILE NAME: BloomFilter.cpp
+ *
+ * DESCRIPTION: BloomFilter class definition
+ **********************************/
+
+#include "BloomFilter.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// odd multipliers spreading the low hash bits over the 32 bits of each word
+static const uint32_t SALT[BLOOM_BLOCK_WORDS] = {
+	0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+	0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: An empty filter sized for the given number of keys
+ */
+BloomFilter::BloomFilter(size_t keys) {
+	size_t bits = max((size_t)1, keys) * BLOOM_BITS_PER_KEY;
+	blocks.assign((bits + sizeof(Block) * 8 - 1) / (sizeof(Block) * 8), Block());
+}
+
+// maskOf() the bit of every word of its block a hash sets
+void BloomFilter::maskOf(uint64_t hash, uint32_t mask[BLOOM_BLOCK_WORDS]) {
+	uint32_t low = (uint32_t)hash;
+	for ( int i = 0; i < BLOOM_BLOCK_WORDS; i++ ) {
+		mask[i] = 1U << ((low * SALT[i]) >> 27);
+	}
+}
+
+/**
+ * FUNCTION NAME: add
+ *
+ * DESCRIPTION: Set the bits of key
+ */
+void BloomFilter::add(string_view key) {
+	uint64_t hash = hash64(key.data(), key.size());
+	uint32_t mask[BLOOM_BLOCK_WORDS];
+	maskOf(hash, mask);
+	Block &block = blocks[blockOf(hash)];
+	for ( int i = 0; i < BLOOM_BLOCK_WORDS; i++ ) {
+		block.words[i] |= mask[i];
+	}
+}
+
+/**
+ * FUNCTION NAME: mayContain
+ *
+ * RETURNS:
+ * false if key was surely never added
+ */
+bool BloomFilter::mayContain(string_view key) const {
+	uint64_t hash = hash64(key.data(), key.size());
+	const Block &block = blocks[blockOf(hash)];
+#if defined(__AVX2__)
+	__m256i salt = _mm256_loadu_si256((const __m256i *)SALT);
+	__m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((uint32_t)hash), salt), 27);
+	__m256i mask = _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+	return _mm256_testc_si256(_mm256_load_si256((const __m256i *)block.words), mask);
+#elif defined(__SSE2__)
+	uint32_t mask[BLOOM_BLOCK_WORDS];
+	maskOf(hash, mask);
+	__m128i low = _mm_loadu_si128((const __m128i *)mask);
+	__m128i high = _mm_loadu_si128((const __m128i *)(mask + 4));
+	__m128i lowHit = _mm_cmpeq_epi32(_mm_and_si128(_mm_load_si128((const __m128i *)block.words), low), low);
+	__m128i highHit = _mm_cmpeq_epi32(_mm_and_si128(_mm_load_si128((const __m128i *)(block.words + 4)), high), high);
+	return _mm_movemask_epi8(_mm_and_si128(lowHit, highHit)) == 0xFFFF;
+#else
+	uint32_t mask[BLOOM_BLOCK_WORDS];
+	maskOf(hash, mask);
+	for ( int i = 0; i < BLOOM_BLOCK_WORDS; i++ ) {
+		if ( (block.words[i] & mask[i]) != mask[i] ) {
+			return false;
+		}
+	}
+	return true;
+#endif
+}
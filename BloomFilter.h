@@ -0,0 +1,61 @@
+/**********************************
+ * FILE NAME: BloomFilter.h
+ *
+ * DESCRIPTION: Header file BloomFilter class
+ **********************************/
+
+#ifndef BLOOMFILTER_H_
+#define BLOOMFILTER_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "Hash.h"
+#include <string_view>
+
+/**
+ * Macros
+ */
+// filter bits per key, about 1% false positives
+#define BLOOM_BITS_PER_KEY 10
+// 32 bit words of a block, one bit is set in each
+#define BLOOM_BLOCK_WORDS 8
+
+/**
+ * CLASS NAME: BloomFilter
+ *
+ * DESCRIPTION: Set of keys that answers "maybe present" or "surely absent", a blocked
+ * 				(split block) bloom filter: the high bits of hash64 of a key, remixed, pick
+ * 				one block of 256 bits, the low bits set one bit in each of the block's 8 words. A
+ * 				membership test reads one block, within one cache line, and compares all 8
+ * 				words at once with SSE2 (AVX2 when available).
+ */
+class BloomFilter {
+	struct alignas(32) Block {
+		uint32_t words[BLOOM_BLOCK_WORDS];
+	};
+
+	vector<Block> blocks;
+
+	// blockOf() the block of a hash. The raw high bits also route a key to its RangeStore
+	// partition, so the keys of a partition's filter (or of one of its LSM runs) share them:
+	// they are remixed first (the murmur3 finalizer) to spread those keys over every block.
+	size_t blockOf(uint64_t hash) const {
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ULL;
+		hash ^= hash >> 33;
+		return (size_t)(((hash >> 32) * blocks.size()) >> 32);
+	}
+	static void maskOf(uint64_t hash, uint32_t mask[BLOOM_BLOCK_WORDS]);
+
+public:
+	BloomFilter(size_t keys = 0);
+	void add(string_view key);
+	bool mayContain(string_view key) const;
+	size_t memoryUsed() const { return blocks.capacity() * sizeof(Block); }
+};
+
+#endif /* BLOOMFILTER_H_ */
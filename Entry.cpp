@@ -1,5 +1,5 @@
 /**********************************
- * FILE NAME: Application.h
+ * FILE NAME: Entry.cpp
  *
  * DESCRIPTION: Entry class definition
  **********************************/
@@ -13,6 +13,25 @@ Entry::Entry(string _value, int _timestamp, ReplicaType _replica){
 	value = _value;
 	timestamp = _timestamp;
 	replica = _replica;
+	version = makeVersion(_timestamp, 0);
+	expiresAt = 0;
+	deleted = false;
+}
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: Entry of a versioned write, expiring at tick _expiresAt unless it is 0, or
+ * 				the tombstone of a versioned delete
+ */
+Entry::Entry(string _value, uint64_t _version, uint64_t _expiresAt, bool _deleted){
+	this->delimiter = ":";
+	value = _value;
+	version = _version;
+	expiresAt = _expiresAt;
+	deleted = _deleted;
+	timestamp = (int)(_version >> (VERSION_SEQUENCE_BITS + VERSION_NODE_BITS));
+	replica = PRIMARY;
 }
 
 /**
@@ -36,6 +55,9 @@ Entry::Entry(string entry){
 	value = tuple.at(0);
 	timestamp = stoi(tuple.at(1));
 	replica = static_cast<ReplicaType>(stoi(tuple.at(2)));
+	version = makeVersion(timestamp, 0);
+	expiresAt = 0;
+	deleted = false;
 }
 
 /**
@@ -46,3 +68,95 @@ Entry::Entry(string entry){
 string Entry::convertToString() {
 	return value + delimiter + to_string(timestamp) + delimiter + to_string(replica);
 }
+
+/**
+ * FUNCTION NAME: encode
+ *
+ * DESCRIPTION: Binary form stored in the hash table, the version, the expiry tick if any,
+ * 				then the value
+ */
+string Entry::encode() const {
+	uint64_t flagged = deleted ? version | ENTRY_DELETED : version;
+	if ( expiresAt == 0 ) {
+		string stored(sizeof(uint64_t), '\0');
+		memcpy(&stored[0], &flagged, sizeof(uint64_t));
+		return stored + value;
+	}
+	flagged |= ENTRY_EXPIRES;
+	string stored(2 * sizeof(uint64_t), '\0');
+	memcpy(&stored[0], &flagged, sizeof(uint64_t));
+	memcpy(&stored[sizeof(uint64_t)], &expiresAt, sizeof(uint64_t));
+	return stored + value;
+}
+
+/**
+ * FUNCTION NAME: decode
+ *
+ * DESCRIPTION: Entry of a value stored in the hash table
+ */
+Entry Entry::decode(const string &stored) {
+	return Entry(string(valueOf(stored)), versionOf(stored), expiryOf(stored), isDeleted(stored));
+}
+
+/**
+ * FUNCTION NAME: makeVersion
+ *
+ * DESCRIPTION: Version of the sequence-th write coordinated by node nodeId at time timestamp
+ */
+uint64_t Entry::makeVersion(int timestamp, int nodeId, int sequence) {
+	return ((uint64_t)timestamp << (VERSION_SEQUENCE_BITS + VERSION_NODE_BITS))
+		| ((uint64_t)(sequence & ((1 << VERSION_SEQUENCE_BITS) - 1)) << VERSION_NODE_BITS)
+		| (uint64_t)(nodeId & ((1 << VERSION_NODE_BITS) - 1));
+}
+
+/**
+ * FUNCTION NAME: versionOf
+ *
+ * DESCRIPTION: Version of a value stored in the hash table, without copying the value
+ */
+uint64_t Entry::versionOf(string_view stored) {
+	uint64_t version = 0;
+	if ( stored.size() >= sizeof(uint64_t) ) {
+		memcpy(&version, stored.data(), sizeof(uint64_t));
+	}
+	return version & ~(ENTRY_EXPIRES | ENTRY_DELETED);
+}
+
+/**
+ * FUNCTION NAME: isDeleted
+ *
+ * DESCRIPTION: Tells if a value stored in the hash table is a tombstone
+ */
+bool Entry::isDeleted(string_view stored) {
+	uint64_t version = 0;
+	if ( stored.size() >= sizeof(uint64_t) ) {
+		memcpy(&version, stored.data(), sizeof(uint64_t));
+	}
+	return (version & ENTRY_DELETED) != 0;
+}
+
+/**
+ * FUNCTION NAME: expiryOf
+ *
+ * DESCRIPTION: Tick a value stored in the hash table expires at, 0 if it never does
+ */
+uint64_t Entry::expiryOf(string_view stored) {
+	uint64_t version = 0, expiresAt = 0;
+	if ( stored.size() >= 2 * sizeof(uint64_t) ) {
+		memcpy(&version, stored.data(), sizeof(uint64_t));
+		if ( version & ENTRY_EXPIRES ) {
+			memcpy(&expiresAt, stored.data() + sizeof(uint64_t), sizeof(uint64_t));
+		}
+	}
+	return expiresAt;
+}
+
+/**
+ * FUNCTION NAME: valueOf
+ *
+ * DESCRIPTION: Value part of an entry stored in the hash table, a view into stored
+ */
+string_view Entry::valueOf(string_view stored) {
+	size_t header = expiryOf(stored) ? 2 * sizeof(uint64_t) : sizeof(uint64_t);
+	return stored.size() >= header ? stored.substr(header) : string_view();
+}
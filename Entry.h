@@ -1,16 +1,41 @@
 /**********************************
- * FILE NAME: Application.h
+ * FILE NAME: Entry.h
  *
  * DESCRIPTION: Header file Entry class
  **********************************/
 
+#ifndef ENTRY_H_
+#define ENTRY_H_
+
 #include "stdincludes.h"
 #include "Message.h"
+#include <stdint.h>
+#include <string_view>
+
+/**
+ * Macros
+ */
+// flag in the stored version of an entry followed by the tick it expires at
+#define ENTRY_EXPIRES (1ULL << 63)
+// flag in the stored version of a tombstone, a deleted key kept so the delete wins over older copies
+#define ENTRY_DELETED (1ULL << 62)
+// low bits of a version holding the coordinator's id, and above them its write sequence number
+#define VERSION_NODE_BITS 16
+#define VERSION_SEQUENCE_BITS 16
 
 /**
  * CLASS NAME: Entry
  *
- * DESCRIPTION: This class describes the entry for each key in the DHT
+ * DESCRIPTION: This class describes the entry for each key in the DHT.
+ * 				The hash table stores entries in the compact binary form written by encode:
+ * 				the 8 byte version followed by the value. A version packs the time of the
+ * 				write in its high bits, then the coordinator's sequence number of the write
+ * 				within that tick, then the id of the coordinator in its low 16 bits, so
+ * 				comparing versions orders writes, last write wins, even two writes a
+ * 				coordinator sends for the same key in one tick. An entry written with a
+ * 				time to live has ENTRY_EXPIRES set in its stored version and the tick it
+ * 				expires at between the version and the value. A delete is stored as a
+ * 				tombstone: an entry without a value with ENTRY_DELETED set in its version.
  */
 class Entry{
 public:
@@ -18,8 +43,23 @@ public:
 	int timestamp;
 	ReplicaType replica;
 	string delimiter;
+	uint64_t version;
+	// tick the entry expires at, 0 if it never does
+	uint64_t expiresAt;
+	// the entry is a tombstone
+	bool deleted;
 
 	Entry(string entry);
 	Entry(string _value, int _timestamp, ReplicaType _replica);
+	Entry(string _value, uint64_t _version, uint64_t _expiresAt = 0, bool _deleted = false);
 	string convertToString();
+	string encode() const;
+	static Entry decode(const string &stored);
+	static uint64_t makeVersion(int timestamp, int nodeId, int sequence = 0);
+	static uint64_t versionOf(string_view stored);
+	static uint64_t expiryOf(string_view stored);
+	static bool isDeleted(string_view stored);
+	static string_view valueOf(string_view stored);
 };
+
+#endif /* ENTRY_H_ */
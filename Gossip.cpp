@@ -0,0 +1,135 @@
+/**********************************
+ * FILE NAME: Gossip.cpp
+ *
+ * DESCRIPTION: Gossip class definition
+ **********************************/
+
+#include "Gossip.h"
+
+/**
+ * FUNCTION NAME: packEntry
+ *
+ * DESCRIPTION: Write id, port and heartbeat of a membership entry into buf.
+ * 				The timestamp is local to every node and is not sent.
+ */
+void Gossip::packEntry(char *buf, const MemberListEntry &entry) {
+	memcpy(buf, &entry.id, sizeof(int));
+	memcpy(buf + sizeof(int), &entry.port, sizeof(short));
+	memcpy(buf + sizeof(int) + sizeof(short), &entry.heartbeat, sizeof(long));
+}
+
+/**
+ * FUNCTION NAME: unpackEntry
+ *
+ * DESCRIPTION: Read an entry written by packEntry and stamp it with the local time
+ */
+MemberListEntry Gossip::unpackEntry(const char *buf, long timestamp) {
+	int id;
+	short port;
+	long heartbeat;
+	memcpy(&id, buf, sizeof(int));
+	memcpy(&port, buf + sizeof(int), sizeof(short));
+	memcpy(&heartbeat, buf + sizeof(int) + sizeof(short), sizeof(long));
+	return MemberListEntry(id, port, heartbeat, timestamp);
+}
+
+/**
+ * FUNCTION NAME: makeTrailer
+ *
+ * DESCRIPTION: Build the membership delta of this node: its own heartbeat, the members it
+ * 				removed during the last GOSSIP_FAILED_TICKS ticks (failures), then the entries
+ * 				refreshed during the last tick (recent joins and heartbeat bumps)
+ *
+ * RETURNS:
+ * trailer bytes to be attached to an outgoing message
+ */
+string Gossip::makeTrailer(Member *memberNode, long now) {
+	vector<MemberListEntry> delta, failed;
+	int id = *(int *)(&memberNode->addr.addr);
+	short port = *(short *)(&memberNode->addr.addr[4]);
+	delta.emplace_back(id, port, memberNode->heartbeat, now);
+	for ( auto &entry : memberNode->failedList ) {
+		if ( delta.size() + failed.size() >= GOSSIP_MAX_ENTRIES ) {
+			break;
+		}
+		if ( now - entry.timestamp <= GOSSIP_FAILED_TICKS ) {
+			failed.push_back(entry);
+		}
+	}
+	for ( auto &entry : memberNode->memberList ) {
+		if ( delta.size() + failed.size() >= GOSSIP_MAX_ENTRIES ) {
+			break;
+		}
+		if ( now - entry.timestamp <= 1 ) {
+			delta.push_back(entry);
+		}
+	}
+
+	unsigned short count = (unsigned short)delta.size();
+	unsigned short failedCount = (unsigned short)failed.size();
+	int magic = GOSSIP_MAGIC;
+	string trailer((count + failedCount) * ENTRY_SIZE + FOOTER_SIZE, '\0');
+	char *buf = &trailer[0];
+	for ( auto &entry : delta ) {
+		packEntry(buf, entry);
+		buf += ENTRY_SIZE;
+	}
+	for ( auto &entry : failed ) {
+		packEntry(buf, entry);
+		buf += ENTRY_SIZE;
+	}
+	memcpy(buf, &count, sizeof(unsigned short));
+	memcpy(buf + sizeof(unsigned short), &failedCount, sizeof(unsigned short));
+	memcpy(buf + 2 * sizeof(unsigned short), &magic, sizeof(int));
+	return trailer;
+}
+
+/**
+ * FUNCTION NAME: trailerSize
+ *
+ * DESCRIPTION: Size of the membership trailer of a message wrapped by attach. The message
+ * 				itself is the size - 1 - trailerSize bytes after the mark.
+ *
+ * RETURNS:
+ * number of trailing bytes taken by the trailer, 0 if the message does not carry one
+ */
+int Gossip::trailerSize(const char *data, int size) {
+	int magic;
+	unsigned short count, failedCount;
+	if ( size < 1 + FOOTER_SIZE || data[0] != GOSSIP_MARK ) {
+		return 0;
+	}
+	memcpy(&magic, data + size - sizeof(int), sizeof(int));
+	memcpy(&count, data + size - FOOTER_SIZE, sizeof(unsigned short));
+	memcpy(&failedCount, data + size - FOOTER_SIZE + sizeof(unsigned short), sizeof(unsigned short));
+	int total = (count + failedCount) * ENTRY_SIZE + FOOTER_SIZE;
+	if ( magic != GOSSIP_MAGIC || count + failedCount > GOSSIP_MAX_ENTRIES || 1 + total > size ) {
+		return 0;
+	}
+	return total;
+}
+
+/**
+ * FUNCTION NAME: readTrailer
+ *
+ * DESCRIPTION: Decode the membership delta carried at the end of a message: the live entries
+ * 				into delta and the failed ones into failed
+ */
+void Gossip::readTrailer(const char *data, int size, long now, vector<MemberListEntry> &delta, vector<MemberListEntry> &failed) {
+	int total = trailerSize(data, size);
+	if ( total == 0 ) {
+		return;
+	}
+	unsigned short count;
+	memcpy(&count, data + size - FOOTER_SIZE, sizeof(unsigned short));
+	int failedCount = (total - FOOTER_SIZE) / ENTRY_SIZE - count;
+	const char *buf = data + size - total;
+	for ( int i = 0; i < count; i++ ) {
+		delta.push_back(unpackEntry(buf, now));
+		buf += ENTRY_SIZE;
+	}
+	for ( int i = 0; i < failedCount; i++ ) {
+		failed.push_back(unpackEntry(buf, now));
+		buf += ENTRY_SIZE;
+	}
+}
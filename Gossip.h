@@ -0,0 +1,53 @@
+/**********************************
+ * FILE NAME: Gossip.h
+ *
+ * DESCRIPTION: Header file of Gossip class
+ **********************************/
+
+#ifndef GOSSIP_H_
+#define GOSSIP_H_
+
+#include "stdincludes.h"
+#include "Member.h"
+
+/**
+ * Macros
+ */
+// first byte of a message that carries a membership delta. A KV store message starts with its
+// transaction id in decimal and a membership message with its small integer type, so neither
+// can start with it.
+#define GOSSIP_MARK ((char)0xA5)
+// closes the trailer, checked along with its counts
+#define GOSSIP_MAGIC 0x50494759
+// max number of membership entries piggybacked on a single message
+#define GOSSIP_MAX_ENTRIES 8
+// ticks a failed member is gossiped for after it was removed
+#define GOSSIP_FAILED_TICKS 5
+
+/**
+ * CLASS NAME: Gossip
+ *
+ * DESCRIPTION: Membership delta trailer shared by the membership protocol (MP1Node)
+ * 				and the key value store (MP2Node). attach wraps any outgoing message as
+ * 				[GOSSIP_MARK][message][trailer], the trailer having the layout
+ * 				[packed entries][packed failed entries][unsigned short count]
+ * 				[unsigned short failed count][int GOSSIP_MAGIC]
+ * 				The receiver knows from the mark that the message carries a trailer, and
+ * 				finds its size from the counts at the end of the buffer.
+ */
+class Gossip {
+public:
+	// bytes used by one packed entry: id, port and heartbeat
+	static const int ENTRY_SIZE = sizeof(int) + sizeof(short) + sizeof(long);
+	// bytes used by the counts and magic that close the trailer
+	static const int FOOTER_SIZE = 2 * sizeof(unsigned short) + sizeof(int);
+
+	static void packEntry(char *buf, const MemberListEntry &entry);
+	static MemberListEntry unpackEntry(const char *buf, long timestamp);
+	static string makeTrailer(Member *memberNode, long now);
+	static string attach(const string &message, const string &trailer) { return GOSSIP_MARK + message + trailer; }
+	static int trailerSize(const char *data, int size);
+	static void readTrailer(const char *data, int size, long now, vector<MemberListEntry> &delta, vector<MemberListEntry> &failed);
+};
+
+#endif /* GOSSIP_H_ */
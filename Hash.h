@@ -0,0 +1,21 @@
+/**********************************
+ * FILE NAME: Hash.h
+ *
+ * DESCRIPTION: Header file of the ring hash function
+ **********************************/
+
+#ifndef HASH_H_
+#define HASH_H_
+
+#include "stdincludes.h"
+#include <stdint.h>
+
+/**
+ * FUNCTION NAME: hash64
+ *
+ * DESCRIPTION: XXH64 of len bytes at data. Unlike std::hash the result is fully specified,
+ * 				so keys and nodes land on the same ring position in every build and process.
+ */
+uint64_t hash64(const void *data, size_t len, uint64_t seed = 0);
+
+#endif /* HASH_H_ */
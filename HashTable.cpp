@@ -5,11 +5,217 @@
  **********************************/
 
 #include "HashTable.h"
+#include "Entry.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-HashTable::HashTable() {}
+const int8_t HashTable::EMPTY;
+const int8_t HashTable::DELETED;
+
+HashTable::HashTable(): arenaDead(0), used(0), deleted(0), rehashes(0) {}
 
 HashTable::~HashTable() {}
 
+/**
+ * FUNCTION NAME: matchGroup
+ *
+ * DESCRIPTION: Bit i is set if slot i of the group is full with the given hash bits
+ */
+uint32_t HashTable::matchGroup(size_t group, int8_t h2) const {
+#ifdef __SSE2__
+	__m128i bytes = _mm_loadu_si128((const __m128i *)&ctrl[group * GROUP_SIZE]);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(h2)));
+#else
+	uint32_t mask = 0;
+	for ( int i = 0; i < GROUP_SIZE; i++ ) {
+		mask |= (uint32_t)(ctrl[group * GROUP_SIZE + i] == h2) << i;
+	}
+	return mask;
+#endif
+}
+
+/**
+ * FUNCTION NAME: emptyInGroup
+ *
+ * DESCRIPTION: Bit i is set if slot i of the group was never used since the last resize
+ */
+uint32_t HashTable::emptyInGroup(size_t group) const {
+	return matchGroup(group, EMPTY);
+}
+
+/**
+ * FUNCTION NAME: freeInGroup
+ *
+ * DESCRIPTION: Bit i is set if slot i of the group is empty or deleted, the control bytes
+ * 				with the sign bit set
+ */
+uint32_t HashTable::freeInGroup(size_t group) const {
+#ifdef __SSE2__
+	__m128i bytes = _mm_loadu_si128((const __m128i *)&ctrl[group * GROUP_SIZE]);
+	return (uint32_t)_mm_movemask_epi8(bytes);
+#else
+	uint32_t mask = 0;
+	for ( int i = 0; i < GROUP_SIZE; i++ ) {
+		mask |= (uint32_t)(ctrl[group * GROUP_SIZE + i] < 0) << i;
+	}
+	return mask;
+#endif
+}
+
+/**
+ * FUNCTION NAME: findSlot
+ *
+ * DESCRIPTION: Probe the groups starting at the one picked by the high bits of the hash,
+ * 				jumping 1, 2, 3... groups ahead, until the key or an empty slot is found.
+ * 				A group with an empty slot ends the probe: an insert would have used it.
+ *
+ * RETURNS:
+ * slot of the key, slots.size() if missing
+ */
+size_t HashTable::findSlot(string_view key, uint64_t hash) const {
+	size_t groups = ctrl.size() / GROUP_SIZE;
+	if ( groups == 0 ) {
+		return slots.size();
+	}
+	int8_t h2 = (int8_t)(hash & 0x7f);
+	size_t group = (hash >> 7) & (groups - 1);
+	for ( size_t step = 1; step <= groups; step++ ) {
+		for ( uint32_t match = matchGroup(group, h2); match != 0; match &= match - 1 ) {
+			size_t slot = group * GROUP_SIZE + __builtin_ctz(match);
+			if ( keyOf(slots[slot]) == key ) {
+				return slot;
+			}
+		}
+		if ( emptyInGroup(group) != 0 ) {
+			break;
+		}
+		group = (group + step) & (groups - 1);
+	}
+	return slots.size();
+}
+
+/**
+ * FUNCTION NAME: insertSlot
+ *
+ * DESCRIPTION: Claim the first free slot on the probe sequence of a key known to be missing,
+ * 				growing the table first when it is 7/8 full
+ *
+ * RETURNS:
+ * slot to store the key in
+ */
+size_t HashTable::insertSlot(uint64_t hash) {
+	if ( (used + deleted + 1) * 8 > ctrl.size() * 7 ) {
+		// mostly deleted slots are reclaimed in place, otherwise the table doubles
+		rehash(ctrl.empty() ? GROUP_SIZE : ((used + 1) * 2 > ctrl.size() ? ctrl.size() * 2 : ctrl.size()));
+	}
+	size_t groups = ctrl.size() / GROUP_SIZE;
+	size_t group = (hash >> 7) & (groups - 1);
+	for ( size_t step = 1; ; step++ ) {
+		uint32_t free = freeInGroup(group);
+		if ( free != 0 ) {
+			size_t slot = group * GROUP_SIZE + __builtin_ctz(free);
+			if ( ctrl[slot] == DELETED ) {
+				deleted--;
+			}
+			ctrl[slot] = (int8_t)(hash & 0x7f);
+			used++;
+			return slot;
+		}
+		group = (group + step) & (groups - 1);
+	}
+}
+
+/**
+ * FUNCTION NAME: eraseSlot
+ *
+ * DESCRIPTION: Free a full slot. It can be marked EMPTY if its group has an empty slot, as
+ * 				no probe goes past such a group, otherwise it becomes DELETED.
+ */
+void HashTable::eraseSlot(size_t slot) {
+	size_t group = slot / GROUP_SIZE;
+	if ( emptyInGroup(group) != 0 ) {
+		ctrl[slot] = EMPTY;
+	}
+	else {
+		ctrl[slot] = DELETED;
+		deleted++;
+	}
+	used--;
+	if ( !slots[slot].isInline() ) {
+		arenaDead += slots[slot].keyLen + slots[slot].valueLen;
+	}
+}
+
+/**
+ * FUNCTION NAME: storePair
+ *
+ * DESCRIPTION: Write key and value to a slot, in the slot itself when they fit, otherwise at
+ * 				the end of the arena. key or value may be views into the arena: they are found
+ * 				again by offset once the arena has grown.
+ */
+void HashTable::storePair(Slot &slot, string_view key, string_view value) {
+	slot.keyLen = (uint32_t)key.size();
+	slot.valueLen = (uint32_t)value.size();
+	if ( slot.isInline() ) {
+		memmove(slot.bytes, key.data(), key.size());
+		memmove(slot.bytes + key.size(), value.data(), value.size());
+		return;
+	}
+	uintptr_t begin = (uintptr_t)arena.data(), end = begin + arena.size();
+	uintptr_t keyAt = (uintptr_t)key.data(), valueAt = (uintptr_t)value.data();
+	bool keyInArena = keyAt >= begin && keyAt < end;
+	bool valueInArena = valueAt >= begin && valueAt < end;
+	size_t offset = arena.size();
+	arena.resize(offset + key.size() + value.size());
+	memcpy(&arena[offset], keyInArena ? &arena[keyAt - begin] : key.data(), key.size());
+	memcpy(&arena[offset + key.size()], valueInArena ? &arena[valueAt - begin] : value.data(), value.size());
+	slot.offset = offset;
+}
+
+/**
+ * FUNCTION NAME: compact
+ *
+ * DESCRIPTION: Copy the live pairs of the arena to a new one once more than half of it is
+ * 				dead. Only offsets change, the slots stay where they are.
+ */
+void HashTable::compact() {
+	if ( arenaDead < ARENA_MIN_DEAD || arenaDead * 2 < arena.size() ) {
+		return;
+	}
+	vector<char> live;
+	live.reserve(arena.size() - arenaDead);
+	for ( size_t i = 0; i < slots.size(); i++ ) {
+		if ( ctrl[i] >= 0 && !slots[i].isInline() ) {
+			const char *data = &arena[slots[i].offset];
+			slots[i].offset = live.size();
+			live.insert(live.end(), data, data + slots[i].keyLen + slots[i].valueLen);
+		}
+	}
+	live.swap(arena);
+	arenaDead = 0;
+}
+
+/**
+ * FUNCTION NAME: rehash
+ *
+ * DESCRIPTION: Move every key to a table of the given capacity, dropping deleted slots
+ */
+void HashTable::rehash(size_t capacity) {
+	vector<int8_t> oldCtrl(capacity, EMPTY);
+	vector<Slot> oldSlots(capacity);
+	oldCtrl.swap(ctrl);
+	oldSlots.swap(slots);
+	used = 0;
+	deleted = 0;
+	rehashes++;
+	for ( size_t i = 0; i < oldSlots.size(); i++ ) {
+		if ( oldCtrl[i] >= 0 ) {
+			slots[insertSlot(hashOf(keyOf(oldSlots[i])))] = oldSlots[i];
+		}
+	}
+}
+
 /**
  * FUNCTION NAME: create
  *
@@ -20,10 +226,155 @@ HashTable::~HashTable() {}
  * false in FAILURE
  */
 bool HashTable::create(string key, string value) {
-	hashTable.emplace(key, value);
+	uint64_t hash = hashOf(key);
+	if ( findSlot(key, hash) != slots.size() ) {
+		return true;
+	}
+	size_t slot = insertSlot(hash);
+	storePair(slots[slot], key, value);
+	if ( onChange ) {
+		string_view newValue = valueOf(slots[slot]);
+		onChange(keyOf(slots[slot]), nullptr, &newValue);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: replaceValue
+ *
+ * DESCRIPTION: Store value in a full slot unless the slot holds a value with the same or a
+ * 				newer version. The old pair is kept for onChange in a copy of the slot, its
+ * 				arena bytes stay in place until the next compaction.
+ *
+ * RETURNS:
+ * true if the value was stored
+ * false if the stored value is at least as new
+ */
+bool HashTable::replaceValue(size_t slot, string_view value) {
+	if ( Entry::versionOf(value) <= Entry::versionOf(valueOf(slots[slot])) ) {
+		return false;
+	}
+	Slot old = slots[slot];
+	storePair(slots[slot], keyOf(old), value);
+	if ( !old.isInline() ) {
+		arenaDead += old.keyLen + old.valueLen;
+	}
+	if ( onChange ) {
+		string_view oldValue = valueOf(old), newValue = valueOf(slots[slot]);
+		onChange(keyOf(slots[slot]), &oldValue, &newValue);
+	}
+	compact();
+	return true;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: This function searches for the key in the hash table and sets value to a view
+ * 				of the stored value, valid until the next change to the table
+ *
+ * RETURNS:
+ * true if found
+ * false if the key is missing
+ */
+bool HashTable::find(string_view key, string_view &value) {
+	size_t slot = findSlot(key, hashOf(key));
+	if ( slot == slots.size() ) {
+		return false;
+	}
+	value = valueOf(slots[slot]);
+	return true;
+}
+
+/**
+ * FUNCTION NAME: upsert
+ *
+ * DESCRIPTION: This function stores the (key,value) pair unless the key already holds a
+ * 				value with the same or a newer version. Values are encoded Entries.
+ *
+ * RETURNS:
+ * true if the value was stored
+ * false if the stored value is at least as new
+ */
+bool HashTable::upsert(string_view key, string_view value) {
+	uint64_t hash = hashOf(key);
+	size_t slot = findSlot(key, hash);
+	if ( slot != slots.size() ) {
+		return replaceValue(slot, value);
+	}
+	slot = insertSlot(hash);
+	storePair(slots[slot], key, value);
+	if ( onChange ) {
+		string_view newValue = valueOf(slots[slot]);
+		onChange(keyOf(slots[slot]), nullptr, &newValue);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: updateIfPresent
+ *
+ * DESCRIPTION: This function stores the value of a key already in the table, last write
+ * 				wins as in upsert, unless accept is given and rejects the stored value
+ *
+ * RETURNS:
+ * true if the key is present, even when its stored value is newer or rejected
+ * false if the key is missing
+ */
+bool HashTable::updateIfPresent(string_view key, string_view value, const function<bool(string_view current)> &accept) {
+	size_t slot = findSlot(key, hashOf(key));
+	if ( slot == slots.size() ) {
+		return false;
+	}
+	if ( !accept || accept(valueOf(slots[slot])) ) {
+		replaceValue(slot, value);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: eraseIfPresent
+ *
+ * DESCRIPTION: This function deletes the key and its value if the key is found
+ *
+ * RETURNS:
+ * true if the key was deleted
+ * false if the key is missing
+ */
+bool HashTable::eraseIfPresent(string_view key) {
+	size_t slot = findSlot(key, hashOf(key));
+	if ( slot == slots.size() ) {
+		return false;
+	}
+	Slot old = slots[slot];
+	eraseSlot(slot);
+	if ( onChange ) {
+		string_view oldValue = valueOf(old);
+		onChange(keyOf(old), &oldValue, nullptr);
+	}
+	compact();
 	return true;
 }
 
+/**
+ * FUNCTION NAME: bulkWrite
+ *
+ * DESCRIPTION: This function writes a batch of (key,value) pairs into the local hash table,
+ * 				last write wins as in upsert
+ *
+ * RETURNS:
+ * number of pairs stored
+ */
+unsigned long HashTable::bulkWrite(const vector<pair<string, string>> &pairs) {
+	unsigned long stored = 0;
+	for ( auto &kv : pairs ) {
+		if ( upsert(kv.first, kv.second) ) {
+			stored++;
+		}
+	}
+	return stored;
+}
+
 /**
  * FUNCTION NAME: read
  *
@@ -34,12 +385,10 @@ bool HashTable::create(string key, string value) {
  * else it returns a NULL
  */
 string HashTable::read(string key) {
-	map<string, string>::iterator search;
-
-	search = hashTable.find(key);
-	if ( search != hashTable.end() ) {
+	string_view value;
+	if ( find(key, value) ) {
 		// Value found
-		return search->second;
+		return string(value);
 	}
 	else {
 		// Value not found
@@ -51,24 +400,15 @@ string HashTable::read(string key) {
  * FUNCTION NAME: update
  *
  * DESCRIPTION: This function updates the given key with the updated value passed in
- * 				if the key is found
+ * 				if the key is found and the stored value is older
  *
  * RETURNS:
  * true on SUCCESS
  * false on FAILURE
  */
 bool HashTable::update(string key, string newValue) {
-	map<string, string>::iterator update;
-
-	if (read(key).empty()) {
-		// Key not found
-		return false;
-	}
-	// Key found
-	//update = hashTable.at(key) = newValue;
-	hashTable.at(key) = newValue;
-	// Update successful
-	return true;
+	// a write older than the stored value is ignored, the key still holds a value
+	return updateIfPresent(key, newValue);
 }
 
 /**
@@ -81,19 +421,7 @@ bool HashTable::update(string key, string newValue) {
  * false on FAILURE
  */
 bool HashTable::deleteKey(string key) {
-	uint eraseCount = 0;
-
-	if (read(key).empty()) {
-		// Key not found
-		return false;
-	}
-	eraseCount = hashTable.erase(key);
-	if ( eraseCount < 1 ) {
-		// Could not erase
-		return false;
-	}
-	// Delete was successful
-	return true;
+	return eraseIfPresent(key);
 }
 
 /**
@@ -106,7 +434,7 @@ bool HashTable::deleteKey(string key) {
  * false otherwise
  */
 bool HashTable::isEmpty() {
-	return hashTable.empty();
+	return used == 0;
 }
 
 /**
@@ -118,7 +446,7 @@ bool HashTable::isEmpty() {
  * size of the table as unit
  */
 unsigned long HashTable::currentSize() {
-	return (unsigned  long)hashTable.size();
+	return (unsigned  long)used;
 }
 
 /**
@@ -127,7 +455,13 @@ unsigned long HashTable::currentSize() {
  * DESCRIPTION: Clear all contents from the hash table
  */
 void HashTable::clear() {
-	hashTable.clear();
+	vector<int8_t>().swap(ctrl);
+	vector<Slot>().swap(slots);
+	vector<char>().swap(arena);
+	arenaDead = 0;
+	used = 0;
+	deleted = 0;
+	rehashes++;
 }
 
 /**
@@ -139,6 +473,41 @@ void HashTable::clear() {
  * unsigned long count (Should be always 1)
  */
 unsigned long HashTable::count(string key) {
-	return (unsigned long) hashTable.count(key);
+	return findSlot(key, hashOf(key)) != slots.size() ? 1 : 0;
 }
 
+/**
+ * FUNCTION NAME: memoryUsed
+ *
+ * DESCRIPTION: Returns the bytes held by the control bytes, the slots and the arena
+ */
+size_t HashTable::memoryUsed() const {
+	return ctrl.capacity() * sizeof(int8_t) + slots.capacity() * sizeof(Slot) + arena.capacity();
+}
+
+/**
+ * FUNCTION NAME: next
+ *
+ * DESCRIPTION: Iterate over the keys in slot order. The cursor holds the next slot and
+ * 				the generation of the table when the scan started: a resize moves the keys
+ * 				to other slots, the scan then starts over from the first slot.
+ *
+ * RETURNS:
+ * true with key and value set, false once every slot was visited
+ */
+bool HashTable::next(TableCursor &cursor, string_view &key, string_view &value) {
+	if ( !cursor.started || cursor.generation != rehashes ) {
+		cursor.started = true;
+		cursor.slot = 0;
+		cursor.generation = rehashes;
+	}
+	while ( cursor.slot < slots.size() ) {
+		size_t slot = cursor.slot++;
+		if ( ctrl[slot] >= 0 ) {
+			key = keyOf(slots[slot]);
+			value = valueOf(slots[slot]);
+			return true;
+		}
+	}
+	return false;
+}
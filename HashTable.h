@@ -11,28 +11,96 @@
  * Header files
  */
 #include "stdincludes.h"
-#include "common.h"
-#include "Entry.h"
+#include "Hash.h"
+#include "StorageEngine.h"
+
+/**
+ * Macros
+ */
+// slots whose control bytes are probed together
+#define GROUP_SIZE 16
+// bytes of key and value stored in the slot itself, longer pairs go to the arena
+#define SLOT_INLINE 24
+// dead arena bytes tolerated before a compaction is considered
+#define ARENA_MIN_DEAD 4096
 
 /**
  * CLASS NAME: HashTable
  *
- * DESCRIPTION: This class is a wrapper to the map provided by C++ STL.
- *
+ * DESCRIPTION: This class is the local key value store of a node, an open addressing hash
+ * 				table in the style of Swiss tables. Every slot has a control byte: EMPTY,
+ * 				DELETED, or the low 7 bits of the key's hash when the slot is full. Lookups
+ * 				probe groups of GROUP_SIZE control bytes at once (with SSE2 when available),
+ * 				and compare keys only in the slots whose control byte matches.
+ * 				A slot holds the key and value bytes back to back, in the slot when they fit in
+ * 				SLOT_INLINE bytes (a 5 character key and a short encoded value do), otherwise in
+ * 				the table's arena. The arena is only appended to; the bytes of replaced and
+ * 				deleted pairs are dead until a compaction copies the live pairs to a new arena.
+ * 				Values are Entries in their encoded form, see Entry.h.
  */
-class HashTable {
+class HashTable : public StorageEngine {
+	static const int8_t EMPTY = -128;
+	static const int8_t DELETED = -2;
+
+	struct Slot {
+		uint32_t keyLen;
+		uint32_t valueLen;
+		union {
+			char bytes[SLOT_INLINE];
+			// start of the pair in the arena when it does not fit in bytes
+			uint64_t offset;
+		};
+		bool isInline() const { return (size_t)keyLen + valueLen <= SLOT_INLINE; }
+	};
+
+	// control bytes, same order as slots, a multiple of GROUP_SIZE
+	vector<int8_t> ctrl;
+	vector<Slot> slots;
+	// key and value bytes of the pairs too long for their slot
+	vector<char> arena;
+	// arena bytes of replaced or deleted pairs
+	size_t arenaDead;
+	// full and deleted slots
+	size_t used;
+	size_t deleted;
+	// number of times the slots were moved by a resize
+	unsigned long rehashes;
+
+	const char *pairData(const Slot &slot) const { return slot.isInline() ? slot.bytes : &arena[slot.offset]; }
+	string_view keyOf(const Slot &slot) const { return string_view(pairData(slot), slot.keyLen); }
+	string_view valueOf(const Slot &slot) const { return string_view(pairData(slot) + slot.keyLen, slot.valueLen); }
+
+	uint32_t matchGroup(size_t group, int8_t h2) const;
+	uint32_t emptyInGroup(size_t group) const;
+	uint32_t freeInGroup(size_t group) const;
+	size_t findSlot(string_view key, uint64_t hash) const;
+	size_t insertSlot(uint64_t hash);
+	void eraseSlot(size_t slot);
+	void storePair(Slot &slot, string_view key, string_view value);
+	bool replaceValue(size_t slot, string_view value);
+	void compact();
+	void rehash(size_t capacity);
+	static uint64_t hashOf(string_view key) { return hash64(key.data(), key.size()); }
 public:
-	map<string, string> hashTable;
-//public:
 	HashTable();
+	// single probe API, the stored value is never copied out. The views returned are valid
+	// until the next change to the table.
+	bool find(string_view key, string_view &value) override;
+	bool upsert(string_view key, string_view value) override;
+	bool updateIfPresent(string_view key, string_view value, const function<bool(string_view current)> &accept = nullptr) override;
+	bool eraseIfPresent(string_view key) override;
+
 	bool create(string key, string value);
+	unsigned long bulkWrite(const vector<pair<string, string>> &pairs);
 	string read(string key);
 	bool update(string key, string newValue);
 	bool deleteKey(string key);
-	bool isEmpty();
-	unsigned long currentSize();
-	void clear();
+	bool isEmpty() override;
+	unsigned long currentSize() override;
+	void clear() override;
 	unsigned long count(string key);
+	size_t memoryUsed() const override;
+	bool next(TableCursor &cursor, string_view &key, string_view &value) override;
 	virtual ~HashTable();
 };
 
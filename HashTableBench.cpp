@@ -0,0 +1,206 @@
+/**********************************
+ * FILE NAME: HashTableBench.cpp
+ *
+ * DESCRIPTION: Benchmark of the HashTable and LsmTable storage engines against the std::map
+ * 				the HashTable replaced, and of HashTables behind the bloom filters of a
+ * 				RangeStore of 1 and of 32 partitions.
+ * 				Usage: ./HashTableBench [max power of ten, default 7]
+ * 				Runs 10^3 keys up to 10^max keys and prints the mean time per operation, and the
+ * 				heap bytes the table holds per key once every key is created.
+ **********************************/
+
+#include "HashTable.h"
+#include "Entry.h"
+#include "LsmTable.h"
+#include "RangeStore.h"
+#include <chrono>
+#include <malloc.h>
+
+/**
+ * CLASS NAME: MapTable
+ *
+ * DESCRIPTION: The previous storage engine, a std::map with the same last write wins rules
+ */
+class MapTable {
+	map<string, string> table;
+public:
+	bool create(const string &key, const string &value) {
+		table.emplace(key, value);
+		return true;
+	}
+	string read(const string &key) {
+		auto search = table.find(key);
+		return search != table.end() ? search->second : "";
+	}
+	bool update(const string &key, const string &value) {
+		auto search = table.find(key);
+		if ( search == table.end() ) {
+			return false;
+		}
+		if ( Entry::versionOf(value) > Entry::versionOf(search->second) ) {
+			search->second = value;
+		}
+		return true;
+	}
+	bool deleteKey(const string &key) {
+		return table.erase(key) > 0;
+	}
+};
+
+/**
+ * CLASS NAME: LsmBench
+ *
+ * DESCRIPTION: An LsmTable behind the calls of run, given a tick of compaction every
+ * 				100 operations
+ */
+class LsmBench {
+	LsmTable table;
+	size_t ops;
+	void step() {
+		if ( ++ops % 100 == 0 ) {
+			table.tick();
+		}
+	}
+public:
+	LsmBench(): table("bench"), ops(0) {}
+	bool create(const string &key, const string &value) {
+		step();
+		return table.upsert(key, value);
+	}
+	string read(const string &key) {
+		step();
+		string_view value;
+		return table.find(key, value) ? string(value) : "";
+	}
+	bool update(const string &key, const string &value) {
+		step();
+		return table.updateIfPresent(key, value);
+	}
+	bool deleteKey(const string &key) {
+		step();
+		return table.eraseIfPresent(key);
+	}
+};
+
+/**
+ * CLASS NAME: StoreBench
+ *
+ * DESCRIPTION: A RangeStore of HashTable partitions behind the calls of run, split at evenly
+ * 				spaced tokens, its filters rebuilt once per 100 operations when due as on a tick
+ */
+template <size_t PARTITIONS> class StoreBench {
+	RangeStore store;
+	size_t ops;
+	void step() {
+		if ( ++ops % 100 == 0 ) {
+			store.tick();
+		}
+	}
+public:
+	StoreBench(): ops(0) {
+		vector<uint64_t> tokens;
+		for ( size_t i = 1; i < PARTITIONS; i++ ) {
+			tokens.push_back(UINT64_MAX / PARTITIONS * i);
+		}
+		store.repartition(tokens);
+	}
+	bool create(const string &key, const string &value) {
+		step();
+		return store.upsert(key, value);
+	}
+	string read(const string &key) {
+		step();
+		string_view value;
+		return store.find(key, value) ? string(value) : "";
+	}
+	bool update(const string &key, const string &value) {
+		step();
+		return store.updateIfPresent(key, value);
+	}
+	bool deleteKey(const string &key) {
+		step();
+		return store.eraseIfPresent(key);
+	}
+};
+
+/**
+ * FUNCTION NAME: nsPerOp
+ *
+ * DESCRIPTION: Run op(i) for every i < n and return the mean time of one call
+ */
+template <typename F> double nsPerOp(size_t n, F op) {
+	auto start = chrono::steady_clock::now();
+	for ( size_t i = 0; i < n; i++ ) {
+		op(i);
+	}
+	auto end = chrono::steady_clock::now();
+	return chrono::duration<double, nano>(end - start).count() / n;
+}
+
+// heapInUse() bytes of heap allocated and not yet freed, large blocks are mapped on their own
+size_t heapInUse() {
+	struct mallinfo2 info = mallinfo2();
+	return info.uordblks + info.hblkhd;
+}
+
+// testKey() the i-th distinct key of 5 alphanumeric characters, the shape of the keys the
+// application creates (KEY_LENGTH in Application.h)
+string testKey(size_t i) {
+	static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+	string key(5, '0');
+	for ( int c = 4; c >= 0; c-- ) {
+		key[c] = alphanum[i % 62];
+		i /= 62;
+	}
+	return key;
+}
+
+/**
+ * FUNCTION NAME: run
+ *
+ * DESCRIPTION: Time create, read of present and missing keys, update and delete of n keys.
+ * 				Keys are read back in another order than they were inserted.
+ */
+template <typename T> void run(const char *name, const vector<string> &keys, const vector<string> &values,
+		const vector<string> &newer, const vector<size_t> &order) {
+	size_t n = keys.size();
+	size_t heapBefore = heapInUse();
+	T *table = new T();
+	size_t found = 0;
+	double create = nsPerOp(n, [&](size_t i) { table->create(keys[i], values[i]); });
+	double bytesPerKey = (double)(heapInUse() - heapBefore) / n;
+	double hit = nsPerOp(n, [&](size_t i) { found += !table->read(keys[order[i]]).empty(); });
+	double miss = nsPerOp(n, [&](size_t i) { found += !table->read(keys[i] + "#").empty(); });
+	double update = nsPerOp(n, [&](size_t i) { table->update(keys[order[i]], newer[order[i]]); });
+	double erase = nsPerOp(n, [&](size_t i) { table->deleteKey(keys[order[i]]); });
+	delete table;
+	if ( found != n ) {
+		cout << name << ": found " << found << " of " << n << " keys" << endl;
+	}
+	printf("%-10s %9zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, n, create, hit, miss, update, erase, bytesPerKey);
+}
+
+int main(int argc, char *argv[]) {
+	int maxPower = argc > 1 ? atoi(argv[1]) : 7;
+	printf("%-10s %9s %10s %10s %10s %10s %10s %10s\n", "table", "keys", "create", "read", "miss", "update", "delete", "bytes/key");
+	size_t n = 100;
+	for ( int power = 3; power <= maxPower; power++ ) {
+		n *= 10;
+		vector<string> keys(n), values(n), newer(n);
+		vector<size_t> order(n);
+		for ( size_t i = 0; i < n; i++ ) {
+			keys[i] = testKey(hash64(&i, sizeof(i)) % (916132832 - n) / n * n + i);
+			values[i] = Entry("value" + to_string(i), Entry::makeVersion(1, 1)).encode();
+			newer[i] = Entry("newValue" + to_string(i), Entry::makeVersion(2, 1)).encode();
+			order[i] = i;
+		}
+		srand(power);
+		random_shuffle(order.begin(), order.end());
+		run<MapTable>("std::map", keys, values, newer, order);
+		run<HashTable>("HashTable", keys, values, newer, order);
+		run<StoreBench<1>>("RangeStore", keys, values, newer, order);
+		run<StoreBench<32>>("Range/32", keys, values, newer, order);
+		run<LsmBench>("LsmTable", keys, values, newer, order);
+	}
+	return 0;
+}
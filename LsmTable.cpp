@@ -0,0 +1,432 @@
+/**********************************
+ * FILE NAME: LsmTable.cpp
+ *
+ * DESCRIPTION: LsmTable class definition
+ **********************************/
+
+#include "LsmTable.h"
+#include "Entry.h"
+#include <sys/stat.h>
+#include <climits>
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: An empty table whose runs are named after name in LSM_DIR
+ */
+LsmTable::LsmTable(const string &name): name(name), keys(0), runsCreated(0), shape(0) {
+	mkdir(LSM_DIR, 0755);
+}
+
+LsmTable::~LsmTable() {
+	clear();
+}
+
+// runs() every run in lookup order, level 0 newest first then the levels
+vector<SortedRun *> LsmTable::runs() const {
+	vector<SortedRun *> all(level0);
+	for ( auto run : levels ) {
+		if ( run ) {
+			all.push_back(run);
+		}
+	}
+	return all;
+}
+
+// newRun() an empty run with a file name of its own
+SortedRun *LsmTable::newRun(size_t expectedKeys) {
+	string path = string(LSM_DIR) + "/" + name + "-" + to_string(runsCreated++) + ".run";
+	return new SortedRun(path, expectedKeys);
+}
+
+/**
+ * FUNCTION NAME: lookup
+ *
+ * DESCRIPTION: Copy the value of key to value, from the newest source that knows the key
+ *
+ * RETURNS:
+ * false if the key is missing or deleted
+ */
+bool LsmTable::lookup(string_view key, string &value) {
+	const SkipList::Node *node = memtable.find(key);
+	if ( node ) {
+		if ( node->tombstone ) {
+			return false;
+		}
+		value = node->value;
+		return true;
+	}
+	for ( auto run : level0 ) {
+		SortedRun::Lookup found = run->get(key, value);
+		if ( found != SortedRun::MISSING ) {
+			return found == SortedRun::PRESENT;
+		}
+	}
+	for ( auto run : levels ) {
+		if ( run == nullptr ) {
+			continue;
+		}
+		SortedRun::Lookup found = run->get(key, value);
+		if ( found != SortedRun::MISSING ) {
+			return found == SortedRun::PRESENT;
+		}
+	}
+	return false;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: See StorageEngine::find, the view is into a buffer of the table
+ */
+bool LsmTable::find(string_view key, string_view &value) {
+	if ( !lookup(key, found) ) {
+		return false;
+	}
+	value = found;
+	return true;
+}
+
+// write() puts a value or tombstone in the memtable and flushes it once full
+void LsmTable::write(string_view key, string_view value, bool tombstone) {
+	memtable.put(key, value, tombstone);
+	if ( memtable.bytes() > LSM_MEMTABLE_BYTES ) {
+		flush();
+	}
+}
+
+/**
+ * FUNCTION NAME: upsert
+ *
+ * DESCRIPTION: See StorageEngine::upsert. The old value is looked up first, for last write
+ * 				wins and for onChange.
+ */
+bool LsmTable::upsert(string_view key, string_view value) {
+	bool present = lookup(key, old);
+	if ( present && Entry::versionOf(value) <= Entry::versionOf(old) ) {
+		return false;
+	}
+	if ( !present ) {
+		keys++;
+	}
+	if ( onChange ) {
+		string_view oldValue = old;
+		onChange(key, present ? &oldValue : nullptr, &value);
+	}
+	write(key, value, false);
+	return true;
+}
+
+/**
+ * FUNCTION NAME: updateIfPresent
+ *
+ * DESCRIPTION: See StorageEngine::updateIfPresent
+ */
+bool LsmTable::updateIfPresent(string_view key, string_view value, const function<bool(string_view current)> &accept) {
+	if ( !lookup(key, old) ) {
+		return false;
+	}
+	if ( (!accept || accept(old)) && Entry::versionOf(value) > Entry::versionOf(old) ) {
+		if ( onChange ) {
+			string_view oldValue = old;
+			onChange(key, &oldValue, &value);
+		}
+		write(key, value, false);
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: eraseIfPresent
+ *
+ * DESCRIPTION: See StorageEngine::eraseIfPresent, the key is hidden by a tombstone
+ */
+bool LsmTable::eraseIfPresent(string_view key) {
+	if ( !lookup(key, old) ) {
+		return false;
+	}
+	keys--;
+	if ( onChange ) {
+		string_view oldValue = old;
+		onChange(key, &oldValue, nullptr);
+	}
+	write(key, "", true);
+	return true;
+}
+
+/**
+ * FUNCTION NAME: flush
+ *
+ * DESCRIPTION: Write the memtable out as the newest level 0 run. If the run cannot be
+ * 				written the memtable keeps its keys and grows. Writes wait for the
+ * 				compactions once level 0 reaches LSM_L0_STOP runs.
+ */
+void LsmTable::flush() {
+	SortedRun *run = newRun(memtable.size());
+	for ( const SkipList::Node *node = memtable.first(); node; node = node->next[0] ) {
+		run->add(node->key, node->value, node->tombstone);
+	}
+	if ( !run->finish() ) {
+		delete run;
+		return;
+	}
+	level0.insert(level0.begin(), run);
+	memtable.clear();
+	shape++;
+	while ( level0.size() >= LSM_L0_STOP ) {
+		if ( !compaction.active && !startCompaction() ) {
+			break;
+		}
+		compactStep(ULONG_MAX);
+	}
+}
+
+/**
+ * FUNCTION NAME: startCompaction
+ *
+ * DESCRIPTION: Pick the next compaction: level 0 into level 1 once it has LSM_L0_RUNS runs,
+ * 				otherwise the first level over its size into the one below it
+ *
+ * RETURNS:
+ * false if no level needs one
+ */
+bool LsmTable::startCompaction() {
+	Compaction &c = compaction;
+	c.inputs.clear();
+	if ( level0.size() >= LSM_L0_RUNS ) {
+		c.inputs = level0;
+		c.target = 0;
+	}
+	else {
+		double capacity = LSM_L1_BYTES;
+		for ( size_t i = 0; i < levels.size() && c.inputs.empty(); i++, capacity *= LSM_LEVEL_RATIO ) {
+			if ( levels[i] && levels[i]->bytes() > capacity ) {
+				c.inputs.push_back(levels[i]);
+				c.target = i + 1;
+			}
+		}
+		if ( c.inputs.empty() ) {
+			return false;
+		}
+	}
+	if ( c.target < levels.size() && levels[c.target] ) {
+		c.inputs.push_back(levels[c.target]);
+	}
+	c.last = true;
+	for ( size_t i = c.target + 1; i < levels.size(); i++ ) {
+		c.last = c.last && levels[i] == nullptr;
+	}
+	size_t expectedKeys = 0;
+	c.iters.clear();
+	for ( auto run : c.inputs ) {
+		expectedKeys += run->size();
+		c.iters.emplace_back(run);
+		c.iters.back().seekFirst();
+	}
+	c.output = newRun(expectedKeys);
+	c.active = true;
+	return true;
+}
+
+/**
+ * FUNCTION NAME: compactStep
+ *
+ * DESCRIPTION: Merge up to records records of the inputs into the output. Of the records
+ * 				of a key only the one of the newest input is kept.
+ */
+void LsmTable::compactStep(unsigned long records) {
+	Compaction &c = compaction;
+	while ( records-- > 0 ) {
+		int newest = -1;
+		for ( size_t i = 0; i < c.iters.size(); i++ ) {
+			if ( c.iters[i].valid && (newest < 0 || c.iters[i].key < c.iters[newest].key) ) {
+				newest = (int)i;
+			}
+		}
+		if ( newest < 0 ) {
+			finishCompaction();
+			return;
+		}
+		SortedRun::Iterator &it = c.iters[newest];
+		if ( !(it.tombstone && c.last) ) {
+			c.output->add(it.key, it.value, it.tombstone);
+		}
+		string key(it.key);
+		for ( auto &other : c.iters ) {
+			if ( other.valid && other.key == key ) {
+				other.next();
+			}
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: finishCompaction
+ *
+ * DESCRIPTION: Replace the inputs by the output. If the output could not be written the
+ * 				inputs stay and the compaction is tried again later.
+ */
+void LsmTable::finishCompaction() {
+	Compaction &c = compaction;
+	c.active = false;
+	c.iters.clear();
+	if ( !c.output->finish() ) {
+		delete c.output;
+		c.output = nullptr;
+		return;
+	}
+	for ( auto run : c.inputs ) {
+		level0.erase(remove(level0.begin(), level0.end(), run), level0.end());
+		replace(levels.begin(), levels.end(), run, (SortedRun *)nullptr);
+		delete run;
+	}
+	c.inputs.clear();
+	if ( levels.size() <= c.target ) {
+		levels.resize(c.target + 1, nullptr);
+	}
+	if ( c.output->size() > 0 ) {
+		levels[c.target] = c.output;
+	}
+	else {
+		delete c.output;
+	}
+	c.output = nullptr;
+	while ( !levels.empty() && levels.back() == nullptr ) {
+		levels.pop_back();
+	}
+	shape++;
+}
+
+/**
+ * FUNCTION NAME: tick
+ *
+ * DESCRIPTION: Run LSM_COMPACTION_RATE records of compaction, starting one if needed
+ */
+void LsmTable::tick() {
+	if ( compaction.active || startCompaction() ) {
+		compactStep(LSM_COMPACTION_RATE);
+	}
+}
+
+/**
+ * FUNCTION NAME: next
+ *
+ * DESCRIPTION: Iterate over the keys in key order, merging the memtable and the runs. The
+ * 				cursor holds the last key returned, a scan resumes after it even when the
+ * 				runs changed in between. The iterators of the runs are kept between calls
+ * 				while the runs stay the same.
+ *
+ * RETURNS:
+ * true with key and value set, false once every key was returned
+ */
+bool LsmTable::next(TableCursor &cursor, string_view &key, string_view &value) {
+	bool fromStart = !cursor.started;
+	cursor.started = true;
+	if ( fromStart || !scan.valid || scan.shape != shape || scan.key != cursor.key ) {
+		scan.iters.clear();
+		for ( auto run : runs() ) {
+			scan.iters.emplace_back(run);
+			if ( fromStart ) {
+				scan.iters.back().seekFirst();
+			}
+			else {
+				scan.iters.back().seekAfter(cursor.key);
+			}
+		}
+		scan.shape = shape;
+		scan.valid = true;
+	}
+	while ( true ) {
+		const SkipList::Node *node = fromStart ? memtable.first() : memtable.seekAfter(cursor.key);
+		string_view best;
+		bool any = false, tombstone = false;
+		if ( node ) {
+			best = node->key;
+			value = node->value;
+			tombstone = node->tombstone;
+			any = true;
+		}
+		for ( auto &it : scan.iters ) {
+			if ( it.valid && (!any || it.key < best) ) {
+				best = it.key;
+				value = it.value;
+				tombstone = it.tombstone;
+				any = true;
+			}
+		}
+		if ( !any ) {
+			scan.valid = false;
+			scan.iters.clear();
+			return false;
+		}
+		cursor.key.assign(best.data(), best.size());
+		cursor.value.assign(value.data(), value.size());
+		for ( auto &it : scan.iters ) {
+			if ( it.valid && it.key == cursor.key ) {
+				it.next();
+			}
+		}
+		scan.key = cursor.key;
+		fromStart = false;
+		if ( !tombstone ) {
+			key = cursor.key;
+			value = cursor.value;
+			return true;
+		}
+	}
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Drop every key and remove the runs
+ */
+void LsmTable::clear() {
+	if ( compaction.active ) {
+		compaction.active = false;
+		compaction.iters.clear();
+		compaction.inputs.clear();
+		delete compaction.output;
+		compaction.output = nullptr;
+	}
+	for ( auto run : runs() ) {
+		delete run;
+	}
+	level0.clear();
+	levels.clear();
+	scan.valid = false;
+	scan.iters.clear();
+	memtable.clear();
+	keys = 0;
+	shape++;
+}
+
+/**
+ * FUNCTION NAME: memoryUsed
+ *
+ * DESCRIPTION: Returns the bytes held in memory: the memtable, and the indexes and filters
+ * 				of the runs
+ */
+size_t LsmTable::memoryUsed() const {
+	size_t bytes = memtable.bytes() + found.capacity() + old.capacity();
+	for ( auto run : runs() ) {
+		bytes += run->memoryUsed();
+	}
+	if ( compaction.output ) {
+		bytes += compaction.output->memoryUsed();
+	}
+	return bytes + (scan.iters.size() + compaction.iters.size()) * RUN_READ_BUFFER;
+}
+
+/**
+ * FUNCTION NAME: diskUsed
+ *
+ * DESCRIPTION: Returns the bytes of the runs on disk
+ */
+size_t LsmTable::diskUsed() const {
+	size_t bytes = 0;
+	for ( auto run : runs() ) {
+		bytes += run->bytes();
+	}
+	return bytes;
+}
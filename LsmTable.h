@@ -0,0 +1,113 @@
+/**********************************
+ * FILE NAME: LsmTable.h
+ *
+ * DESCRIPTION: Header file LsmTable class
+ **********************************/
+
+#ifndef LSMTABLE_H_
+#define LSMTABLE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "StorageEngine.h"
+#include "SkipList.h"
+#include "SortedRun.h"
+
+/**
+ * Macros
+ */
+// memtable bytes that trigger a flush to a new level 0 run
+#define LSM_MEMTABLE_BYTES (256 * 1024)
+// level 0 runs that trigger their compaction into level 1
+#define LSM_L0_RUNS 4
+// level 0 runs at which writes wait for the compactions to catch up
+#define LSM_L0_STOP 12
+// bytes of level 1, every further level holds LSM_LEVEL_RATIO times more
+#define LSM_L1_BYTES (4 * LSM_MEMTABLE_BYTES)
+#define LSM_LEVEL_RATIO 10
+// records a compaction merges per tick
+#define LSM_COMPACTION_RATE 4096
+
+/**
+ * CLASS NAME: LsmTable
+ *
+ * DESCRIPTION: Log structured merge tree, the StorageEngine for key sets larger than memory.
+ * 				Writes go to a skip list memtable; a full memtable is written out as an
+ * 				immutable SortedRun in level 0. Level 0 runs may overlap, every deeper level
+ * 				is a single run LSM_LEVEL_RATIO times larger than the one above it.
+ * 				Compaction merges level 0 into level 1, or a full level into the next one,
+ * 				LSM_COMPACTION_RATE records per tick; its inputs serve reads until the output
+ * 				replaces them. A lookup goes from the memtable to the oldest level and stops
+ * 				at the first source that knows the key, deleted keys are tombstones until a
+ * 				compaction into the last level drops them.
+ * 				Runs live in LSM_DIR for the life of the table only, durability across
+ * 				restarts is left to Persistence.
+ */
+class LsmTable : public StorageEngine {
+	struct Compaction {
+		bool active;
+		// newest first
+		vector<SortedRun *> inputs;
+		vector<SortedRun::Iterator> iters;
+		// index in levels the output replaces
+		size_t target;
+		// no level below the target holds keys, tombstones can be dropped
+		bool last;
+		SortedRun *output;
+		Compaction(): active(false), target(0), last(false), output(nullptr) {}
+	};
+	// iterators of the last scan, positioned after key while shape is unchanged
+	struct Scan {
+		bool valid;
+		unsigned long shape;
+		string key;
+		vector<SortedRun::Iterator> iters;
+		Scan(): valid(false), shape(0) {}
+	};
+
+	string name;
+	SkipList memtable;
+	// newest first
+	vector<SortedRun *> level0;
+	// levels[i] is level i + 1, nullptr while empty
+	vector<SortedRun *> levels;
+	Compaction compaction;
+	Scan scan;
+	unsigned long keys;
+	unsigned long runsCreated;
+	// bumped whenever runs are added or removed
+	unsigned long shape;
+	// value returned by find, and the old value of a write
+	string found;
+	string old;
+
+	vector<SortedRun *> runs() const;
+	SortedRun *newRun(size_t expectedKeys);
+	bool lookup(string_view key, string &value);
+	void write(string_view key, string_view value, bool tombstone);
+	void flush();
+	bool startCompaction();
+	void compactStep(unsigned long records);
+	void finishCompaction();
+
+public:
+	LsmTable(const string &name);
+	LsmTable(const LsmTable &other) = delete;
+	LsmTable &operator=(const LsmTable &other) = delete;
+	bool find(string_view key, string_view &value) override;
+	bool upsert(string_view key, string_view value) override;
+	bool updateIfPresent(string_view key, string_view value, const function<bool(string_view current)> &accept = nullptr) override;
+	bool eraseIfPresent(string_view key) override;
+	bool isEmpty() override { return keys == 0; }
+	unsigned long currentSize() override { return keys; }
+	void clear() override;
+	size_t memoryUsed() const override;
+	bool next(TableCursor &cursor, string_view &key, string_view &value) override;
+	void tick() override;
+	size_t diskUsed() const;
+	virtual ~LsmTable();
+};
+
+#endif /* LSMTABLE_H_ */
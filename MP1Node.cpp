@@ -26,6 +26,8 @@ MP1Node::MP1Node(Member *member, Params *params, EmulNet *emul, Log *log, Addres
 	this->log = log;
 	this->par = params;
 	this->memberNode->addr = *address;
+	this->joinChunksLeft = 0;
+	this->joinRequestTime = 0;
 }
 
 /**
@@ -107,9 +109,13 @@ int MP1Node::initThisNode(Address *joinaddr) {
     // node is up!
 	memberNode->nnb = 0;
 	memberNode->heartbeat = 0;
-	memberNode->pingCounter = TFAIL;
+	memberNode->pingCounter = 0;
 	memberNode->timeOutCounter = -1;
     initMemberListTable(memberNode);
+    windows.clear();
+    joinView.clear();
+    joinChunks.clear();
+    joinChunksLeft = 0;
 
     return 0;
 }
@@ -154,6 +160,7 @@ int MP1Node::introduceSelfToGroup(Address *joinaddr) {
 
         // send JOINREQ message to introducer member
         emulNet->ENsend(&memberNode->addr, joinaddr, (char *)msg, sizeof(MessageHdr));
+        joinRequestTime = par->getcurrtime();
 
         free(msg);
     }
@@ -189,6 +196,11 @@ void MP1Node::nodeLoop() {
 
     // Wait until you're in the group...
     if( !memberNode->inGroup ) {
+        // ...asking again if part of the membership view got lost
+        if( par->getcurrtime() - joinRequestTime >= JOIN_RETRY ) {
+            Address joinaddr = getJoinAddress();
+            introduceSelfToGroup(&joinaddr);
+        }
     	return;
     }
 
@@ -227,6 +239,19 @@ bool MP1Node::recvCallBack(void *env, char *data, int size ) {
 	/*
 	 * Your code goes here
 	 */
+    // membership delta piggybacked on KV store traffic, handed over by MP2Node on its own
+    // or appended to one of our messages
+    int trailer = Gossip::trailerSize(data, size);
+    if (trailer > 0) {
+        vector<MemberListEntry> delta, failed;
+        Gossip::readTrailer(data, size, par->getcurrtime(), delta, failed);
+        handleDelta(delta, failed);
+        // strip the mark in front and the trailer
+        data++;
+        size -= 1 + trailer;
+        if (size == 0)
+            return true;
+    }
     // cast to header
     MessageHdr *msg = (MessageHdr*) data;
     // reply to JOINREQ message by sending over your membership list
@@ -234,7 +259,7 @@ bool MP1Node::recvCallBack(void *env, char *data, int size ) {
         //add to your membership list
         addMember(msg);
         Address *dstAddr = &(msg->addr);
-        sendMsg(dstAddr,MsgTypes::JOINREP);
+        sendJoinRep(dstAddr);
         //MessageHdr *msgReply = makeMsg(MsgTypes::JOINREP);
         //printAddress(&msg->addr);
         //printAddress(&msgReply->addr);
@@ -242,15 +267,8 @@ bool MP1Node::recvCallBack(void *env, char *data, int size ) {
         //std::cout << "send [" << par->getcurrtime() << "] JOINREP [" << memberNode->addr.getAddress() << "] to " << msg->addr.getAddress() << std::endl;
         //delete msgReply;
     } else if (msg->msgType == MsgTypes::JOINREP){
-        addMember(msg);
-        // merge membership list with current list and
-        memberNode->inGroup = true; // member is now in group
-        memberNode->nnb = msg->msgList.size();
-        // printAddress(&msg->addr);
-        // for (auto iter = msg->msgList.begin(); iter != msg->msgList.end(); iter++){            
-        //     std::cout<<"above member  has list entry " << iter->id <<" "<< std::endl;
-        // }
-        // handleJoinRep(msg);
+        // one chunk of the introducer's membership list, the node joins once all chunks are in
+        handleJoinRep(msg, data, size);
     } else if (msg->msgType == MsgTypes::MPROT){
         handleProt(msg);
 
@@ -281,23 +299,28 @@ void MP1Node::nodeLoopOps() {
     //}
     if (memberNode-> bFailed == false){
         memberNode->heartbeat += 1;
-        // delete member
+        // delete members whose suspicion level crossed the threshold
         auto it = remove_if(memberNode->memberList.begin(), memberNode->memberList.end(),
             [&](const MemberListEntry & val){
-                if(par->getcurrtime() - val.timestamp >= TREMOVE){
-                    auto addr = getAddr(&val); 
-                    log->logNodeRemove(&memberNode->addr, &addr);
-                    memberNode->nnb--;
-                    std::cout<< memberNode->addr.getAddress() << " removed "<< val.id <<":"<<val.port <<" at time "<< par->getcurrtime()<<std::endl;
+                if(suspicion(val) >= PHI_CONVICT){
+                    removeMember(val);
                     return true;            
                 } else
                     return false;            
             });
         memberNode->memberList.erase(it, memberNode->memberList.end());
+        // failures are gossiped for GOSSIP_FAILED_TICKS ticks
+        auto gone = remove_if(memberNode->failedList.begin(), memberNode->failedList.end(),
+            [&](const MemberListEntry & val){ return par->getcurrtime() - val.timestamp > GOSSIP_FAILED_TICKS; });
+        memberNode->failedList.erase(gone, memberNode->failedList.end());
 
-        // all to all heartbeat for now
+        // all to all heartbeat for now, peers that got our delta piggybacked on KV store
+        // traffic during the last tick are skipped
         for(auto mem: memberNode->memberList) {
             Address addr = getAddr(&mem);
+            auto pb = memberNode->piggybacked.find(addr.getAddress());
+            if (pb != memberNode->piggybacked.end() && par->getcurrtime() - pb->second <= 1)
+                continue;
             //std::cout << "send [" << par->getcurrtime() << "] PING [" << memberNode->addr.getAddress() << "] to " << address.getAddress() << std::endl;
             sendMsg(&addr, MsgTypes::MPROT);
         }
@@ -437,7 +460,7 @@ void MP1Node::addMember(MessageHdr *msg){
 //same as above but uses MemberListEntry and checks for freshness
 void MP1Node::addMember(MemberListEntry *entry){
     Address addr = getAddr(entry);
-    if (addr == memberNode->addr){
+    if (addr == memberNode->addr || recentlyFailed(*entry)){
         return;
     }
     if (par->getcurrtime() - entry->timestamp < TREMOVE){
@@ -458,10 +481,9 @@ void MP1Node::handleProt(MessageHdr *msg){
         if (chk->id == id && chk->port == port) {
             found = 1;
             if (chk->heartbeat < msg->heartbeat)
-                chk->heartbeat = msg->heartbeat;
+                heartbeatArrived(chk, msg->heartbeat);
             else
-                 chk->heartbeat++;
-            chk->timestamp = par->getcurrtime();
+                heartbeatArrived(chk, chk->heartbeat + 1);
             
         } 
     }
@@ -478,13 +500,183 @@ void MP1Node::handleProt(MessageHdr *msg){
         found = 0;
         MemberListEntry *chk = checkMember(id,port);
         if (chk != nullptr){
-            if (chk->heartbeat < ind.heartbeat){
-                    chk->heartbeat = ind.heartbeat;
-                    chk->timestamp = par->getcurrtime();
-                }
+            if (chk->heartbeat < ind.heartbeat)
+                heartbeatArrived(chk, ind.heartbeat);
+        } else {
+            addMember(&(*j));
+        }
+    }
+}
+
+// handleDelta() merges a membership delta piggybacked on KV store traffic into the member list.
+// A failed member is removed unless a newer heartbeat of it arrived here since.
+void MP1Node::handleDelta(vector<MemberListEntry> &delta, vector<MemberListEntry> &failed){
+    for (auto j = delta.begin(); j != delta.end(); j++){
+        MemberListEntry *chk = checkMember(j->id, j->port);
+        if (chk != nullptr){
+            if (chk->heartbeat < j->heartbeat)
+                heartbeatArrived(chk, j->heartbeat);
         } else {
             addMember(&(*j));
         }
     }
+    for (auto &f : failed){
+        auto it = find_if(memberNode->memberList.begin(), memberNode->memberList.end(),
+            [&](const MemberListEntry & val){ return val.id == f.id && val.port == f.port; });
+        if (it != memberNode->memberList.end() && it->heartbeat <= f.heartbeat){
+            removeMember(*it);
+            memberNode->memberList.erase(it);
+        }
+    }
+}
+
+// removeMember() forgets a member found failed, here or by the peer that gossiped it, and
+// records it in the failed list so the failure is gossiped on. The caller erases the entry.
+void MP1Node::removeMember(const MemberListEntry &entry){
+    auto addr = getAddr(&entry);
+    log->logNodeRemove(&memberNode->addr, &addr);
+    memberNode->nnb--;
+    std::cout<< memberNode->addr.getAddress() << " removed "<< entry.id <<":"<<entry.port <<" at time "<< par->getcurrtime()<<std::endl;
+    memberNode->piggybacked.erase(addr.getAddress());
+    windows.erase(make_pair(entry.id, entry.port));
+    memberNode->failedList.emplace_back(entry.id, entry.port, entry.heartbeat, par->getcurrtime());
+}
+
+// recentlyFailed() tells if a member was removed as failed lately and the entry brings no
+// newer heartbeat of it, so a stale entry gossiped by a peer does not add it back
+bool MP1Node::recentlyFailed(const MemberListEntry &entry){
+    for (auto &f : memberNode->failedList){
+        if (f.id == entry.id && f.port == entry.port && entry.heartbeat <= f.heartbeat)
+            return true;
+    }
+    return false;
+}
+
+// heartbeatArrived() refreshes a member entry with a newer heartbeat and feeds the arrival
+// to the failure detector of that member
+void MP1Node::heartbeatArrived(MemberListEntry *entry, long heartbeat){
+    entry->heartbeat = heartbeat;
+    entry->timestamp = par->getcurrtime();
+    auto key = make_pair(entry->id, entry->port);
+    auto w = windows.find(key);
+    if (w == windows.end())
+        windows.emplace(key, ArrivalWindow(entry->timestamp));
+    else
+        w->second.addArrival(entry->timestamp);
+}
+
+// suspicion() returns the phi value of a member, members heard of but never heartbeated
+// start their window at the time they were added
+double MP1Node::suspicion(const MemberListEntry &entry){
+    auto key = make_pair(entry.id, entry.port);
+    auto w = windows.find(key);
+    if (w == windows.end())
+        w = windows.emplace(key, ArrivalWindow(entry.timestamp)).first;
+    return w->second.phi(par->getcurrtime());
+}
+
+/**
+ * Constructor of the ArrivalWindow class
+ */
+ArrivalWindow::ArrivalWindow(long now): count(0), next(0), sum(0), lastArrival(now) {}
+
+/**
+ * FUNCTION NAME: addArrival
+ *
+ * DESCRIPTION: Record a heartbeat arrival, overwriting the oldest interval once the window is full
+ */
+void ArrivalWindow::addArrival(long now) {
+    long interval = now - lastArrival;
+    if (interval <= 0)
+        return; // heartbeats arriving within the same tick count once
+    lastArrival = now;
+    if (count == PHI_WINDOW)
+        sum -= intervals[next];
+    else
+        count++;
+    intervals[next] = interval;
+    sum += interval;
+    next = (next + 1) % PHI_WINDOW;
+}
+
+/**
+ * FUNCTION NAME: phi
+ *
+ * DESCRIPTION: Suspicion level of the member at time now. Inter-arrival times are modelled
+ * 				as exponentially distributed, so phi = -log10(P(no heartbeat for t ticks))
+ * 				= t / mean * log10(e)
+ */
+double ArrivalWindow::phi(long now) {
+    double mean = count > 0 ? (double)sum / count : PHI_MIN_INTERVAL;
+    if (mean < PHI_MIN_INTERVAL)
+        mean = PHI_MIN_INTERVAL;
+    return (now - lastArrival) / mean * M_LOG10E;
+}
+
+// sendJoinRep() streams this node's member list to a joining node as JOINREP chunks,
+// each small enough to fit in MAX_MSG_SIZE
+void MP1Node::sendJoinRep(Address *addr){
+    int hdrSize = sizeof(MessageHdr) + sizeof(JoinChunkHdr);
+    int perChunk = (par->MAX_MSG_SIZE - (int)sizeof(en_msg) - hdrSize - 1) / Gossip::ENTRY_SIZE;
+    int n = memberNode->memberList.size();
+    int total = max(1, (n + perChunk - 1) / perChunk);
+
+    MessageHdr msg;
+    msg.msgType = MsgTypes::JOINREP;
+    msg.addr = memberNode->addr;
+    msg.heartbeat = memberNode->heartbeat;
+    vector<char> buf(hdrSize + perChunk * Gossip::ENTRY_SIZE);
+    memcpy(buf.data(), &msg, sizeof(MessageHdr));
+    for (int seq = 0; seq < total; seq++) {
+        JoinChunkHdr chunk;
+        chunk.seq = seq;
+        chunk.total = total;
+        chunk.count = min(perChunk, n - seq * perChunk);
+        memcpy(buf.data() + sizeof(MessageHdr), &chunk, sizeof(JoinChunkHdr));
+        char *entry = buf.data() + hdrSize;
+        for (int i = 0; i < chunk.count; i++) {
+            Gossip::packEntry(entry, memberNode->memberList[seq * perChunk + i]);
+            entry += Gossip::ENTRY_SIZE;
+        }
+        emulNet->ENsend(&memberNode->addr, addr, buf.data(), hdrSize + chunk.count * Gossip::ENTRY_SIZE);
+    }
 }
 
+// handleJoinRep() collects one JOINREP chunk. Once every chunk of the view has arrived the
+// introducer and the view are merged into the member list and the node joins the group.
+void MP1Node::handleJoinRep(MessageHdr *msg, char *data, int size){
+    int hdrSize = sizeof(MessageHdr) + sizeof(JoinChunkHdr);
+    if (memberNode->inGroup || size < hdrSize)
+        return;
+    JoinChunkHdr chunk;
+    memcpy(&chunk, data + sizeof(MessageHdr), sizeof(JoinChunkHdr));
+    if (chunk.seq >= chunk.total || size < hdrSize + chunk.count * Gossip::ENTRY_SIZE)
+        return;
+    // a stream of a different size is a newer view, start over
+    if (joinChunks.size() != chunk.total) {
+        joinView.clear();
+        joinChunks.assign(chunk.total, false);
+        joinChunksLeft = chunk.total;
+    }
+    if (joinChunks[chunk.seq])
+        return;
+    joinChunks[chunk.seq] = true;
+    joinChunksLeft--;
+    char *entry = data + hdrSize;
+    for (int i = 0; i < chunk.count; i++) {
+        joinView.push_back(Gossip::unpackEntry(entry, par->getcurrtime()));
+        entry += Gossip::ENTRY_SIZE;
+    }
+    if (joinChunksLeft > 0)
+        return;
+
+    addMember(msg);
+    for (auto j = joinView.begin(); j != joinView.end(); j++) {
+        if (checkMember(j->id, j->port) == nullptr)
+            addMember(&(*j));
+    }
+    memberNode->inGroup = true; // member is now in group
+    memberNode->nnb = memberNode->memberList.size();
+    joinView.clear();
+    joinChunks.clear();
+}
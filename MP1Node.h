@@ -14,12 +14,21 @@
 #include "Member.h"
 #include "EmulNet.h"
 #include "Queue.h"
+#include "Gossip.h"
 
 /**
  * Macros
  */
+// gossiped entries not refreshed for this many ticks are not admitted to the member list
 #define TREMOVE 20
-#define TFAIL 5
+// heartbeat inter-arrival samples kept per member by the failure detector
+#define PHI_WINDOW 16
+// suspicion level at which a member is considered failed and removed
+#define PHI_CONVICT 8.0
+// floor on the mean inter-arrival time, in ticks
+#define PHI_MIN_INTERVAL 1.0
+// ticks to wait for the full membership view before sending JOINREQ again
+#define JOIN_RETRY 10
 
 /*
  * Note: You can change/add any functions in MP1Node.{h,cpp}
@@ -48,6 +57,40 @@ typedef struct MessageHdr { // the whole msg
 	vector<MemberListEntry> msgList {}; // the member list for the sender node
 }MessageHdr;
 
+/**
+ * STRUCT NAME: JoinChunkHdr
+ *
+ * DESCRIPTION: Follows the MessageHdr of a JOINREP. The introducer streams its member list
+ * 				as total chunks of count packed entries each, and the joiner is done once it has
+ * 				seen every seq from 0 to total - 1.
+ */
+typedef struct JoinChunkHdr {
+	unsigned short seq; // index of this chunk
+	unsigned short total; // number of chunks making up the view
+	unsigned short count; // number of entries packed after this header
+}JoinChunkHdr;
+
+/**
+ * CLASS NAME: ArrivalWindow
+ *
+ * DESCRIPTION: Phi-accrual failure detector state of a single member. Keeps the last
+ * 				PHI_WINDOW heartbeat inter-arrival times in a ring buffer and turns the time
+ * 				since the last heartbeat into a suspicion level that adapts to network delay
+ * 				and message drops.
+ */
+class ArrivalWindow {
+private:
+	long intervals[PHI_WINDOW];
+	int count;
+	int next;
+	long sum;
+	long lastArrival;
+public:
+	ArrivalWindow(long now);
+	void addArrival(long now);
+	double phi(long now);
+};
+
 /**
  * CLASS NAME: MP1Node
  *
@@ -60,6 +103,15 @@ private:
 	Params *par;
 	Member *memberNode;
 	char NULLADDR[6];
+	// failure detector state of every member <(id, port), window>
+	map<pair<int, short>, ArrivalWindow> windows;
+	// membership view being assembled from JOINREP chunks
+	vector<MemberListEntry> joinView;
+	// which JOINREP chunks have been received
+	vector<bool> joinChunks;
+	int joinChunksLeft;
+	// time the last JOINREQ was sent
+	long joinRequestTime;
 
 public:
 	MP1Node(Member *, Params *, EmulNet *, Log *, Address *);
@@ -90,6 +142,13 @@ public:
 	Address getAddr(int id, short port);
 	Address* readAddr(MessageHdr *msg);
 	void handleProt(MessageHdr *msg);
+	void handleDelta(vector<MemberListEntry> &delta, vector<MemberListEntry> &failed);
+	void removeMember(const MemberListEntry &entry);
+	bool recentlyFailed(const MemberListEntry &entry);
+	void sendJoinRep(Address *addr);
+	void handleJoinRep(MessageHdr *msg, char *data, int size);
+	void heartbeatArrived(MemberListEntry *entry, long heartbeat);
+	double suspicion(const MemberListEntry &entry);
 };
 
 #endif /* _MP1NODE_H_ */
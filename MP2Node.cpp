@@ -8,20 +8,70 @@
 /**
  * constructor
  */
-MP2Node::MP2Node(Member *memberNode, Params *par, EmulNet * emulNet, Log * log, Address * address) {
+MP2Node::MP2Node(Member *memberNode, Params *par, EmulNet * emulNet, Log * log, Address * address): expiries(par->getcurrtime()) {
 	this->memberNode = memberNode;
 	this->par = par;
 	this->emulNet = emulNet;
 	this->log = log;
-	ht = new HashTable();
+	store = new RangeStore(par->STORAGE_ENGINE, address->getAddress());
 	this->memberNode->addr = *address;
+	this->gossipTrailerTime = -1;
+	this->persist = nullptr;
+	this->recoverySync = false;
+	this->hintCount = 0;
+	this->versionTime = -1;
+	this->versionSequence = 0;
+	// reload what this node stored before it went down, before changes are logged again. The
+	// emulator never restarts a node within a run, so the files found are left by an earlier
+	// run: their old versions would beat the writes of this one, they are only reloaded when
+	// asked to and otherwise replaced by an empty snapshot.
+	if (par->PERSIST == PERSIST_FRESH) {
+		persist = new Persistence(address->getAddress());
+		persist->snapshot(*store);
+	}
+	else if (par->PERSIST == PERSIST_RECOVER) {
+		persist = new Persistence(address->getAddress());
+		RecoveryStats stats = persist->recover(*store);
+		if (stats.snapshotKeys + stats.logRecords > 0)
+			log->LOG(address, "#STATSLOG# recovered %lu keys from the snapshot and %lu log records (%zu bytes) in %.2f ms",
+				stats.snapshotKeys, stats.logRecords, stats.bytesRead, stats.millis);
+		recoverySync = !store->isEmpty();
+		// the recovered keys with a time to live expire on schedule
+		for (size_t i = 0; i < store->size(); i++)
+			store->partition(i).forEach([this](string_view key, string_view value) {
+				if (Entry::expiryOf(value))
+					expiries.schedule(string(key), Entry::expiryOf(value));
+			});
+	}
+	// keep the hash trees, the log and the expiries in step with every change of the local table
+	store->onChange = [this](size_t partition, string_view key, const string_view *oldValue, const string_view *newValue) {
+		merkleChange(partition, key, oldValue, newValue);
+		if (newValue && Entry::expiryOf(*newValue))
+			expiries.schedule(string(key), Entry::expiryOf(*newValue));
+		if (persist) {
+			if (newValue)
+				persist->logPut(key, *newValue);
+			else
+				persist->logErase(key);
+		}
+	};
 }
 
 /**
  * Destructor
  */
 MP2Node::~MP2Node() {
-	delete ht;
+	delete rebalanceJob.image;
+	for (auto &download : downloads) {
+		if (download.second.fd < 0)
+			continue;
+		close(download.second.fd);
+		unlink(download.second.path.c_str());
+	}
+	for (auto &load : loads)
+		delete load.image;
+	delete persist;
+	delete store;
 	delete memberNode;
 	// clean up transaction map
 	auto it = txMap.begin();
@@ -52,7 +102,8 @@ void MP2Node::updateRing() {
 	 */
 	curMemList = getMembershipList();
 	// add current node to the ring.
-	curMemList.emplace_back(Node(this->memberNode->addr));
+	for (int token = 0; token < par->VNODES; token++)
+		curMemList.emplace_back(Node(this->memberNode->addr, token));
 
 	/*
 	 * Step 2: Construct the ring
@@ -72,6 +123,8 @@ void MP2Node::updateRing() {
 		}
 	}
 	ring = curMemList; // update ring 
+	if (change)
+		buildReplicaTable();
 	// if (!change){
 	// 	std::cout<< "No need to update ring with size: " <<ring.size()<<std::endl;
 	// }
@@ -86,13 +139,21 @@ void MP2Node::updateRing() {
 		//std::cout<<"Need to update KV store ring"<<std::endl;
 		stabilizationProtocol();
 	}
+	expireKeys();
+	rebalance();
+	antiEntropy();
+	replayHints();
+	collectGarbage();
+	loadImages();
+	// background work of the storage engine, LSM compactions
+	store->tick();
 }
 
 /**
  * FUNCTION NAME: getMembershipList
  *
  * DESCRIPTION: This function goes through the membership list from the Membership protocol/MP1 and
- * 				i) generates the hash code for each member
+ * 				i) generates the hash code for each of the VNODES tokens of each member
  * 				ii) populates the ring member in MP2Node class
  * 				It returns a vector of Nodes. Each element in the vector contain the following fields:
  * 				a) Address of the node
@@ -107,7 +168,9 @@ vector<Node> MP2Node::getMembershipList() {
 		short port = this->memberNode->memberList.at(i).getport();
 		memcpy(&addressOfThisMember.addr[0], &id, sizeof(int));
 		memcpy(&addressOfThisMember.addr[4], &port, sizeof(short));
-		curMemList.emplace_back(Node(addressOfThisMember));
+		for ( int token = 0; token < par->VNODES; token++ ) {
+			curMemList.emplace_back(Node(addressOfThisMember, token));
+		}
 	}	
 	return curMemList;
 }
@@ -119,21 +182,29 @@ vector<Node> MP2Node::getMembershipList() {
  * 				HASH FUNCTION USED FOR CONSISTENT HASHING
  *
  * RETURNS:
- * size_t position on the ring
+ * uint64_t position on the ring
  */
-size_t MP2Node::hashFunction(string key) {
-	std::hash<string> hashFunc;
-	size_t ret = hashFunc(key);
-	return ret%RING_SIZE;
+uint64_t MP2Node::hashFunction(string_view key) {
+	return hash64(key.data(), key.size());
 }
 
 
 //-----------------------------------------------------------------------
 //   Helper and wrapper functions
 // makes a transaction object and adds it to the txMap map at this node
-void MP2Node::makeTx(int txId, MessageType mT, string key, string value){
+void MP2Node::makeTx(int txId, MessageType mT, string key, string value, int ttl){
 	int timestamp = this->par->getcurrtime();
-	TxStat* trans = new TxStat(txId, timestamp, mT, key, value);
+	int quorum = (mT == READ) ? par->READ_QUORUM : par->WRITE_QUORUM;
+	TxStat* trans = new TxStat(txId, timestamp, mT, key, value, par->REPLICATION_FACTOR, quorum);
+	// writes are versioned by the coordinator's clock, sequence number within the tick and id,
+	// the newest version wins at replicas
+	if (timestamp != versionTime) {
+		versionTime = timestamp;
+		versionSequence = 0;
+	}
+	trans->version = Entry::makeVersion(timestamp, *(int *)(&memberNode->addr.addr), versionSequence++);
+	// every node runs on the same clock, so the expiry travels as the tick it happens at
+	trans->expiresAt = ttl > 0 ? (uint64_t)timestamp + ttl : 0;
 	this->txMap.emplace(txId, trans);
 }
 
@@ -141,15 +212,18 @@ void MP2Node::makeTx(int txId, MessageType mT, string key, string value){
 // also adds a transaction object onto the transaction status map for this node
 // basically a wrapper for Message constructor + transaction maker.
 
-Message MP2Node::makeMsg(MessageType mT, string key, string value){
+Message MP2Node::makeMsg(MessageType mT, string key, string value, int ttl){
 	int txId = g_transID; // get global transaction id
-	makeTx(txId, mT, key, value);
+	makeTx(txId, mT, key, value, ttl);
 	if(mT == CREATE || mT == UPDATE){
 		Message msg(txId, this->memberNode->addr, mT, key, value);
+		msg.version = txMap[txId]->version;
+		msg.expiresAt = txMap[txId]->expiresAt;
 		return msg;
 	}
 	else if(mT == READ || mT == DELETE){
 		Message msg(txId, this->memberNode->addr, mT, key);
+		msg.version = txMap[txId]->version;
 		return msg;
 	}
 }
@@ -162,19 +236,21 @@ Message MP2Node::makeMsg(MessageType mT, string key, string value){
  * 				1) Constructs the message
  * 				2) Finds the replicas of this key
  * 				3) Sends a message to the replica
+ * 				A ttl above 0 makes the key expire ttl ticks from now at every replica
  */
-void MP2Node::clientCreate(string key, string value) {
+void MP2Node::clientCreate(string key, string value, int ttl) {
 	/*
 	 * Implement this
 	 */
 	// make message which also adds a pending transaction to txMap
-	Message msg = makeMsg(MessageType::CREATE, key, value);
+	Message msg = makeMsg(MessageType::CREATE, key, value, ttl);
 	string message = msg.toString();
 
 	auto replicas = findNodes(key); // get replicas for this key 
 	// send a message to each replica
-	for (auto&  idx : replicas){
-		emulNet->ENsend(&memberNode->addr, idx.getAddress(), message);
+	for (int i = 0; i < replicas.size(); i++){
+		sendMsg(replicas.at(i).getAddress(), message);
+		txMap[msg.transID]->pending.push_back(*replicas.at(i).getAddress());
 		// string fromNode = memberNode->addr.getAddress();
 		// string toNode = (idx.getAddress())->getAddress();
 		// std::cout<<"Node:" << fromNode <<" is sending create msg to node: "<< toNode << " for key "<< key <<std::endl;
@@ -201,8 +277,9 @@ void MP2Node::clientRead(string key){
 
 	auto replicas = findNodes(key); // get replicas for this key 
 	// send a message to each replica
-	for (auto&  idx : replicas){
-		emulNet->ENsend(&memberNode->addr, idx.getAddress(), message);
+	for (int i = 0; i < replicas.size(); i++){
+		sendMsg(replicas.at(i).getAddress(), message);
+		txMap[msg.transID]->pending.push_back(*replicas.at(i).getAddress());
 	}
 	g_transID++; // increment global transaction count for simulation
 }
@@ -215,19 +292,22 @@ void MP2Node::clientRead(string key){
  * 				1) Constructs the message
  * 				2) Finds the replicas of this key
  * 				3) Sends a message to the replica
+ * 				A ttl above 0 makes the key expire ttl ticks from now, without one the key
+ * 				no longer expires
  */
-void MP2Node::clientUpdate(string key, string value){
+void MP2Node::clientUpdate(string key, string value, int ttl){
 	/*
 	 * Implement this
 	 */
 	// make message which also adds a pending transaction to txMap
-	Message msg = makeMsg(MessageType::UPDATE, key, value);
+	Message msg = makeMsg(MessageType::UPDATE, key, value, ttl);
 	string message = msg.toString();
 
 	auto replicas = findNodes(key); // get replicas for this key 
 	// send a message to each replica
-	for (auto&  idx : replicas){
-		emulNet->ENsend(&memberNode->addr, idx.getAddress(), message);
+	for (int i = 0; i < replicas.size(); i++){
+		sendMsg(replicas.at(i).getAddress(), message);
+		txMap[msg.transID]->pending.push_back(*replicas.at(i).getAddress());
 	}
 	g_transID++; // increment global transaction count for simulation
 }
@@ -251,8 +331,9 @@ void MP2Node::clientDelete(string key){
 
 	auto replicas = findNodes(key); // get replicas for this key 
 	// send a message to each replica
-	for (auto&  idx : replicas){
-		emulNet->ENsend(&memberNode->addr, idx.getAddress(), message);
+	for (int i = 0; i < replicas.size(); i++){
+		sendMsg(replicas.at(i).getAddress(), message);
+		txMap[msg.transID]->pending.push_back(*replicas.at(i).getAddress());
 		// string fromNode = memberNode->addr.getAddress();
 		// string toNode = (idx.getAddress())->getAddress();
 		// std::cout<<"Node:" << fromNode <<" is sending delete msg to node: "<< toNode << " for key "<< key <<std::endl;
@@ -270,36 +351,21 @@ void MP2Node::clientDelete(string key){
  * 			   	1) Inserts key value into the local hash table
  * 			   	2) Return true or false based on success or failure
  */
-bool MP2Node::createKeyValue(string key, string value, ReplicaType replica, int txId) {
+bool MP2Node::createKeyValue(string key, string value, ReplicaType replica, int txId, uint64_t version, uint64_t expiresAt) {
 	/*
 	 * Implement this
 	 */
 	// Insert key, value, replicaType into the hash table
-	// if txId == SP then check if key already exists as don't want to overwrite
-	// bool success = false; 
-	// string isPresent = this->ht->read(key);
-	// if (isPresent == "")
-	//     success = this->ht->create(key, value); // create key but no logging as this is a background process
-	// if (txId != SP_MSG){
-	//     if(success)
-	// 	    log->logCreateSuccess(&memberNode->addr, false, txId, key, value);
-	//     else 
-	// 	    log->logCreateFail(&memberNode->addr, false, txId, key, value);
- //    }
-	// return success;
-	bool success = false;
+	// the value is stored with its version and fails if a newer value is already stored. The
+	// same write arriving again, e.g. after the rebalance job brought it, still succeeds.
+	string_view stored;
+	bool success = this->store->upsert(key, Entry(value, version, expiresAt).encode()) ||
+		(this->store->find(key, stored) && Entry::versionOf(stored) == version && !Entry::isDeleted(stored));
 	if(txId != SP_MSG){
-		success = this->ht->create(key, value);
 		if(success)
 			log->logCreateSuccess(&memberNode->addr, false, txId, key, value);
 		else 
 			log->logCreateFail(&memberNode->addr, false, txId, key, value);	
-	}else{
-		string content = this->ht->read(key);
-		bool exist = (content != "");
-		if(!exist){
-			success = this->ht->create(key, value);	
-		}
 	}
 	return success;
 
@@ -317,14 +383,18 @@ string MP2Node::readKey(string key, int txId) {
 	/*
 	 * Implement this
 	 */
-	// Read key from local hash table and return value
-	string value = this->ht->read(key);
-	if (value != "")
-		log->logReadSuccess(&memberNode->addr, false, txId, key, value);
-	else
+	// Read key from local hash table and return the stored entry, "" if missing. A deleted
+	// key is missing, and so is an expired key even before its timer erased it.
+	string_view stored;
+	bool found = findEntry(key, stored);
+	if (found && (Entry::isDeleted(stored) || expired(stored)))
+		found = false;
+	if (!found) {
 		log->logReadFail(&memberNode->addr, false, txId, key);
-
-	return value;
+		return "";
+	}
+	log->logReadSuccess(&memberNode->addr, false, txId, key, string(Entry::valueOf(stored)));
+	return string(stored);
 }
 
 /**
@@ -335,12 +405,28 @@ string MP2Node::readKey(string key, int txId) {
  * 				1) Update the key to the new value in the local hash table
  * 				2) Return true or false based on success or failure
  */
-bool MP2Node::updateKeyValue(string key, string value, ReplicaType replica, int txId) {
+bool MP2Node::updateKeyValue(string key, string value, ReplicaType replica, int txId, uint64_t version, uint64_t expiresAt) {
 	/*
 	 * Implement this
 	 */
-	// Update key in local hash table and return true or false
-	bool success = this->ht->update(key, value);
+	// Update key in local hash table and return true or false, fails if the key is missing,
+	// deleted or expired, even before its timer erased it: an update does not renew an expired
+	// key. It also fails if a newer value is stored, and as in createKeyValue succeeds for the
+	// same write arriving again. The store is probed once, checking and replacing the entry in
+	// place. A key only in a received image gets the new value in the store, its load keeps
+	// the newest.
+	string entry = Entry(value, version, expiresAt).encode();
+	bool live = false;
+	uint64_t current = 0;
+	auto newer = [&](string_view stored) {
+		live = !Entry::isDeleted(stored) && !expired(stored);
+		current = Entry::versionOf(stored);
+		return live && current < version;
+	};
+	string_view imaged;
+	if (!this->store->updateIfPresent(key, entry, newer) && imageFind(key, imaged) && newer(imaged))
+		this->store->upsert(key, entry);
+	bool success = live && current <= version;
 	if (success) 
 		log->logUpdateSuccess(&memberNode->addr, false, txId, key, value);
 	else 
@@ -357,13 +443,35 @@ bool MP2Node::updateKeyValue(string key, string value, ReplicaType replica, int
  * 				1) Delete the key from the local hash table
  * 				2) Return true or false based on success or failure
  */
-bool MP2Node::deletekey(string key, int txId) {
+bool MP2Node::deletekey(string key, int txId, uint64_t version) {
 	/*
 	 * Implement this
 	 */
-	// Delete the key from the local hash table
-	// logging done here as well
-	bool success = this->ht->deleteKey(key);
+	// Delete the key from the local hash table, it fails if the key is missing, expired or
+	// deleted already, or if a newer value is stored. The key is replaced by a tombstone of
+	// the delete's version, which wins over the older copies anti-entropy, hints or transfers
+	// bring in later, and is purged by the expiry timers TOMBSTONE_GRACE ticks later. As in
+	// updateKeyValue the store is probed once, and a key that is nowhere gets no tombstone.
+	// Logging done here as well.
+	string tombstone = Entry("", version, (uint64_t)par->getcurrtime() + TOMBSTONE_GRACE, true).encode();
+	bool live = false;
+	uint64_t current = 0;
+	auto newer = [&](string_view stored) {
+		live = !Entry::isDeleted(stored) && !expired(stored);
+		current = Entry::versionOf(stored);
+		return live && current < version;
+	};
+	string_view imaged;
+	if (!this->store->updateIfPresent(key, tombstone, newer) && imageFind(key, imaged) && newer(imaged))
+		this->store->upsert(key, tombstone);
+	bool success = live && current < version;
+	// a key still in a received image is hidden there and not loaded
+	if (success) {
+		for (auto &load : loads) {
+			if (load.image->find(key, imaged))
+				load.deleted.insert(key);
+		}
+	}
 	// log this operation
 	if (txId != SP_MSG){
 	    if (success) {
@@ -380,25 +488,60 @@ bool MP2Node::deletekey(string key, int txId) {
 }
 
 
+// keyCount() number of keys stored at this node, primary and replica copies alike
+unsigned long MP2Node::keyCount(){
+	return store->currentSize();
+}
+
+// storeBytes() memory held by the local hash table
+size_t MP2Node::storeBytes(){
+	return store->memoryUsed();
+}
+
+// sendMsg() sends a message to another node. While this node is in the group its membership
+// delta is piggybacked on the message, which stands in for the next heartbeat to that peer.
+void MP2Node::sendMsg(Address *toaddr, string message){
+	bool piggybacked = false;
+	if (memberNode->inGroup){
+		if (gossipTrailerTime != par->getcurrtime()){
+			gossipTrailer = Gossip::makeTrailer(memberNode, par->getcurrtime());
+			gossipTrailerTime = par->getcurrtime();
+		}
+		if (1 + message.size() + gossipTrailer.size() + sizeof(en_msg) < (size_t)par->MAX_MSG_SIZE){
+			message = Gossip::attach(message, gossipTrailer);
+			piggybacked = true;
+		}
+	}
+	int sent = emulNet->ENsend(&memberNode->addr, toaddr, message);
+	if (sent > 0 && piggybacked)
+		memberNode->piggybacked[toaddr->getAddress()] = par->getcurrtime();
+}
+
 //----------------------------------------
 // helper functions for the server messages and use provide functions from Message class
 // sends reply messages from server for server operations to client
-void MP2Node::srvReply(MessageType mT, Address* fromaddr, int txId, bool success, string data){
+void MP2Node::srvReply(MessageType mT, Address* fromaddr, int txId, bool success, string data, uint64_t version, uint64_t expiresAt){
 	MessageType repMsg;
 	// set reply message type
 	if (mT == MessageType::READ){
 		repMsg = MessageType::READREPLY;
 		Message msg(txId, this->memberNode->addr, data);
+		msg.version = version;
+		msg.expiresAt = expiresAt;
 		// send message
 	    string message = msg.toString();
-	    emulNet->ENsend(&memberNode->addr, fromaddr, message);   
+	    sendMsg(fromaddr, message);   
 	}
 	else{
 		repMsg = MessageType::REPLY;
 		Message msg(txId, this->memberNode->addr, repMsg, success);
-		// send message
+		msg.value = data;
+		// send message, once the write is on disk when persisting
 	    string message = msg.toString();
-	    emulNet->ENsend(&memberNode->addr, fromaddr, message);   
+	    if (persist)
+	    	heldReplies.emplace_back(*fromaddr, message);
+	    else
+	    	sendMsg(fromaddr, message);   
 	}
 	
 }
@@ -431,7 +574,20 @@ void MP2Node::checkMessages() {
 		size = memberNode->mp2q.front().size;
 		memberNode->mp2q.pop();
 
-		string message(data, data + size); // create string from data to data + size, range iterator version of string ctr.
+		// hand a piggybacked membership delta over to the membership protocol, as an empty
+		// message carrying the trailer
+		int trailer = Gossip::trailerSize(data, size);
+		int skip = 0;
+		if ( trailer > 0 ) {
+			string wrapped = Gossip::attach("", string(data + size - trailer, trailer));
+			char *delta = (char *) malloc(wrapped.size() * sizeof(char));
+			memcpy(delta, wrapped.data(), wrapped.size());
+			Queue::enqueue(&memberNode->mp1q, delta, wrapped.size());
+			skip = 1;
+			size -= trailer;
+		}
+
+		string message(data + skip, data + size); // create string from data to data + size, range iterator version of string ctr.
 
 		/*
 		 * Handle the message types here
@@ -447,7 +603,7 @@ void MP2Node::checkMessages() {
 					assert(1!=1);
 				}
 				// create key value pair at this server
-				bool success = createKeyValue(msg.key, msg.value, msg.replica, msg.transID);
+				bool success = createKeyValue(msg.key, msg.value, msg.replica, msg.transID, msg.version, msg.expiresAt);
 				// send reply if this is not a stabilization protocol create request as those happen in the background
 				if (msg.transID != SP_MSG)
 					std:: cout<< "normal create from message: "<<message<< "k,v = "<< msg.key<<", "<< msg.value<< std::endl;
@@ -456,14 +612,19 @@ void MP2Node::checkMessages() {
 
 			}
 			case MessageType::READ:{
-				string value = readKey(msg.key, msg.transID);
-				bool success = !value.empty();
-				srvReply(msg.type, &msg.fromAddr, msg.transID, success, value);
+				string stored = readKey(msg.key, msg.transID);
+				bool success = !stored.empty();
+				if (success) {
+					Entry entry = Entry::decode(stored);
+					srvReply(msg.type, &msg.fromAddr, msg.transID, success, entry.value, entry.version, entry.expiresAt);
+				} else {
+					srvReply(msg.type, &msg.fromAddr, msg.transID, success);
+				}
 				break;
 
 			}
 			case MessageType::UPDATE:{
-				bool success = updateKeyValue(msg.key, msg.value, msg.replica, msg.transID);
+				bool success = updateKeyValue(msg.key, msg.value, msg.replica, msg.transID, msg.version, msg.expiresAt);
 				srvReply(msg.type, &msg.fromAddr, msg.transID, success);
 				// if (success)
 				// 	std::cout << "updated "<<std::endl;
@@ -473,7 +634,7 @@ void MP2Node::checkMessages() {
 
 			}
 			case MessageType::DELETE:{
-				bool success = deletekey(msg.key, msg.transID);
+				bool success = deletekey(msg.key, msg.transID, msg.version);
 				if (msg.transID != SP_MSG)
 			        srvReply(msg.type, &msg.fromAddr, msg.transID, success);
 				break;
@@ -483,9 +644,14 @@ void MP2Node::checkMessages() {
 			case MessageType::REPLY:{
 				// need to check msg.transID in  pending in-flight transactions at this node
 				auto it = txMap.find(msg.transID);
-				if (it == txMap.end())
+				if (it == txMap.end()){
+					// or the ack of a hint or garbage collection batch
+					hintAcked(msg.transID);
+					gcAcked(msg.transID, msg.fromAddr, msg.value);
 					break; // not a pending transaction maybe a thirs replica reply
+				}
 				auto tx = txMap[msg.transID];
+				tx->replied(msg.fromAddr);
 				tx->repCnt++;
 				if (msg.success)
 					tx->sucCnt ++;
@@ -497,21 +663,78 @@ void MP2Node::checkMessages() {
 				if (it == txMap.end())
 					break; // not a pending transaction maybe a thirs replica reply
 				auto tx = txMap[msg.transID];
+				tx->replied(msg.fromAddr);
 				tx->repCnt++;
-				tx->value = msg.value;
+				tx->readReplies.emplace_back(msg.fromAddr, msg.value.empty() ? "" : Entry(msg.value, msg.version, msg.expiresAt).encode());
 				if (msg.value != "")
 					tx->sucCnt++;
 				break;				
 			}
+			// keys moved here by the stabilization protocol of another node or pushed by
+			// anti-entropy, not logged, or hinted writes replayed by a coordinator, which are
+			// acked. Last write wins, the keys that expired on the way are dropped. Garbage
+			// collection only refreshes the keys held here, so a deleted key whose tombstone is
+			// purged already is never brought back. A garbage collection batch is acked with
+			// the keys held at its version or newer.
+			case MessageType::TRANSFER:{
+				if (msg.refresh) {
+					string held;
+					for (auto &kv : msg.pairs) {
+						string_view stored;
+						if (!expired(kv.second))
+							store->updateIfPresent(kv.first, kv.second);
+						held += expired(kv.second) ||
+							(findEntry(kv.first, stored) && Entry::versionOf(stored) >= Entry::versionOf(kv.second)) ? '1' : '0';
+					}
+					if (msg.transID != SP_MSG)
+						srvReply(msg.type, &msg.fromAddr, msg.transID, true, held);
+					break;
+				}
+				msg.pairs.erase(remove_if(msg.pairs.begin(), msg.pairs.end(),
+					[this](const pair<string, string> &kv) { return expired(kv.second); }), msg.pairs.end());
+				store->bulkWrite(msg.pairs);
+				if (msg.transID != SP_MSG)
+					srvReply(msg.type, &msg.fromAddr, msg.transID, true);
+				break;
+			}
+			// anti-entropy with another replica of one of our ranges
+			case MessageType::MERKLE:{
+				handleMerkle(msg);
+				break;
+			}
+			// a chunk of the image of a range moved here by the stabilization protocol
+			case MessageType::IMAGE:{
+				handleImage(msg);
+				break;
+			}
 		}
-		updateTxMap();
 	}
 
 	/*
 	 * This function should also ensure all READ and UPDATE operation
 	 * get QUORUM replies
 	 */
-	
+	// once per tick even without messages, replicas that never answer are only caught by the timeout
+	updateTxMap();
+	persistTick();
+}
+
+// persistTick() commits the changes of this tick to disk in one go, then sends the replies
+// held for them. Every SNAPSHOT_PERIOD ticks the log is compacted into a new snapshot once
+// it has grown past half the size of the last one.
+void MP2Node::persistTick(){
+	if (!persist)
+		return;
+	persist->commit();
+	for (auto &reply : heldReplies)
+		sendMsg(&reply.first, reply.second);
+	heldReplies.clear();
+	if (par->getcurrtime() % par->SNAPSHOT_PERIOD == 0 && persist->logSize() > 0 && persist->logSize() > persist->snapshotSize() / 2) {
+		size_t logBytes = persist->logSize();
+		size_t bytes = persist->snapshot(*store);
+		log->LOG(&memberNode->addr, "#STATSLOG# snapshot of %lu keys, %zu bytes, replaces %zu bytes of log",
+			store->currentSize(), bytes, logBytes);
+	}
 }
 
 // creat log message based on client transaction state after 3 received messages or timeout 
@@ -547,50 +770,284 @@ void MP2Node::clientLog(TxStat* tx, bool isCoordinator, bool success, int transI
 				log->logDeleteFail(&memberNode->addr, isCoordinator, transID, tx->key);
 			break;
 		}
+		// replies, transfers, merkle and image messages are server side, never a client transaction
+		default:
+			break;
 	}
 
 }
 
 // updates txMap based on incoming reply messages.
-// check if 3 replies received and of 2 successful messages received in each txMap entry for
-// each pending transaction. 
+// a transaction succeeds once quorum (R for reads, W for writes) of its N replicas replied
+// successfully, and fails as soon as more than N - quorum replied with a failure.
 void MP2Node::updateTxMap(){
 	auto it = txMap.begin();
 	while (it != txMap.end()){
-		if (it->second->repCnt == 3){
-			// 3 replies received, can decide now
-			bool status = it->second->sucCnt >= 2;
-			//if (!status)
-			//	std::cout<< "Failed to get enough successful messages "<< it->second->sucCnt << std::endl;
-			clientLog(it->second, true, status, it->first);
-			delete it->second;
-			it = txMap.erase(it);
-			continue;
-		}
-		else{
-			//speedup early transaction completion for example when first two replies are a success, or the first 
-			//two replies are a failure, or timeout
-			if ((it->second->sucCnt == 2) || (it->second->repCnt-it->second->sucCnt == 2)){
-				bool status = it->second->sucCnt >= 2;
-			   clientLog(it->second, true, status, it->first);
-			   delete it->second;
-			   it = txMap.erase(it);
-			   continue;
+		TxStat *tx = it->second;
+		bool reached = tx->sucCnt >= tx->quorum;
+		bool unreachable = tx->repCnt - tx->sucCnt > tx->replicas - tx->quorum;
+		if (!tx->logged && (reached || unreachable)){
+			if (tx->mT == READ){
+				int votes;
+				string newest = tx->readValue(votes);
+				tx->value = newest.empty() ? "" : Entry::decode(newest).value;
 			}
-			
+			clientLog(tx, true, reached, it->first);
+			tx->logged = true;
 		}
 		// quorum took too long at client
-		if (this->par->getcurrtime() - it->second->getTimestamp() > 10){
-			clientLog(it->second, true, false, it->first);
-			delete it->second;
+		bool timedOut = this->par->getcurrtime() - tx->getTimestamp() > 10;
+		if (timedOut && !tx->logged){
+			clientLog(tx, true, false, it->first);
+			tx->logged = true;
+		}
+		// a transaction is only dropped once its outcome was logged, one whose key has no
+		// replicas yet times out as a failure
+		if (tx->logged && (tx->pending.empty() || timedOut)){
+			// a write that succeeded without some replicas leaves them a hint
+			if (timedOut && reached && (tx->mT == CREATE || tx->mT == UPDATE))
+				for (auto &addr : tx->pending)
+					addHint(addr, tx->key, Entry(tx->value, tx->version, tx->expiresAt).encode());
+			if (tx->mT == READ)
+				readRepair(tx);
+			delete tx;
 			it = txMap.erase(it);
 			continue;
+		}
+		it++;
+	}
 
+}
+
+// addHint() keeps a write a replica missed until it can be replayed, the newest version wins
+void MP2Node::addHint(Address &target, const string &key, const string &value){
+	auto targetHints = hints.find(target.getAddress());
+	if (targetHints != hints.end()) {
+		auto hint = targetHints->second.find(key);
+		if (hint != targetHints->second.end()) {
+			if (Entry::versionOf(value) > Entry::versionOf(hint->second))
+				hint->second = value;
+			return;
 		}
+	}
+	if (hintCount >= MAX_HINTS)
+		return;
+	hints[target.getAddress()][key] = value;
+	hintCount++;
+}
 
+// replayHints() sends the hints of every replica still in the ring in TRANSFER batches that
+// the replica acks. Batches not acked by the next replay are sent again, to a replica that
+// keeps missing them after exponentially longer waits, as it is likely down. Hints of a
+// replica that left the ring are dropped: its ranges were handed to new replicas by the
+// rebalance job, sent by an old replica that did take the write, as the write reached a quorum.
+void MP2Node::replayHints(){
+	int now = par->getcurrtime();
+	if (hints.empty() || now % HINT_REPLAY_PERIOD != 0)
+		return;
+	for (auto &batch : hintBatches) {
+		pair<int, int> &backoff = hintBackoff[batch.second.first];
+		if (backoff.second <= now) {
+			backoff.first = min(backoff.first + 1, HINT_MAX_BACKOFF);
+			backoff.second = now + (HINT_REPLAY_PERIOD << backoff.first);
+		}
+	}
+	hintBatches.clear();
+	size_t limit = transferLimit();
+	auto it = hints.begin();
+	while (it != hints.end()){
+		Address target(it->first);
+		if (!inRing(target)){
+			hintCount -= it->second.size();
+			hintBackoff.erase(it->first);
+			it = hints.erase(it);
+			continue;
+		}
+		auto backoff = hintBackoff.find(it->first);
+		if (backoff != hintBackoff.end() && backoff->second.second > now){
+			it++;
+			continue;
+		}
+		vector<Address> to(1, target);
+		Message batch(g_transID, memberNode->addr, MessageType::TRANSFER, 0, 0);
+		size_t batchSize = batch.transferSize();
+		for (auto &kv : it->second){
+			size_t size = Message::pairSize(kv.first, kv.second);
+			if (batchSize + size > limit && !batch.pairs.empty()){
+				hintBatches[batch.transID] = make_pair(it->first, batch.pairs);
+				sendTransfer(batch, to);
+				batch = Message(++g_transID, memberNode->addr, MessageType::TRANSFER, 0, 0);
+				batchSize = batch.transferSize();
+			}
+			batch.pairs.emplace_back(kv.first, kv.second);
+			batchSize += size;
+		}
+		hintBatches[batch.transID] = make_pair(it->first, batch.pairs);
+		sendTransfer(batch, to);
+		g_transID++;
 		it++;
 	}
+}
+
+// hintAcked() forgets the hints of an acked batch, unless a newer write replaced them meanwhile
+void MP2Node::hintAcked(int transID){
+	auto batch = hintBatches.find(transID);
+	if (batch == hintBatches.end())
+		return;
+	hintBackoff.erase(batch->second.first);
+	auto target = hints.find(batch->second.first);
+	if (target != hints.end()){
+		for (auto &kv : batch->second.second){
+			auto hint = target->second.find(kv.first);
+			if (hint != target->second.end() && hint->second == kv.second){
+				target->second.erase(hint);
+				hintCount--;
+			}
+		}
+		if (target->second.empty())
+			hints.erase(target);
+	}
+	hintBatches.erase(batch);
+}
+
+// collectGarbage() pushes the keys of the ranges this node is no longer a replica of to the
+// replicas of these ranges in refresh TRANSFERs, which update the keys the replicas hold
+// but never create one, as a key missing there may have been deleted since. The keys are
+// deleted here as the acks come in, see gcAcked(). It looks
+// at GC_RATE keys per tick, once the ring has been stable for GC_DELAY ticks and no
+// rebalance job runs, so the new replicas most likely have the keys already.
+void MP2Node::collectGarbage(){
+	int now = par->getcurrtime();
+	for (auto it = gc.batches.begin(); it != gc.batches.end(); ) {
+		if (now - it->second.sentTime > GC_ACK_TIMEOUT)
+			it = gc.batches.erase(it);
+		else
+			it++;
+	}
+	if (trees.empty() || rebalanceJob.active || now - gc.ringChangeTime < GC_DELAY)
+		return;
+	if (gc.partition >= store->size()) {
+		// pass over, its keys are deleted or kept once all of its batches are done
+		if (!gc.batches.empty())
+			return;
+		if (gc.passKeys > 0)
+			log->LOG(&memberNode->addr, "#STATSLOG# gc: %lu keys dropped, %zu bytes reclaimed, %zu bytes in use (%lu keys %zu bytes since start)",
+				gc.passKeys, gc.passBytes, store->memoryUsed(), gc.totalKeys, gc.totalBytes);
+		gc.partition = 0;
+		gc.cursor = TableCursor();
+		gc.passKeys = 0;
+		gc.passBytes = 0;
+	}
+
+	size_t limit = transferLimit();
+	GcBatch batch;
+	Message msg(g_transID++, memberNode->addr, MessageType::TRANSFER, 0, 0);
+	msg.refresh = true;
+	size_t batchSize = msg.transferSize();
+	string_view key, value;
+	for (int scanned = 0; scanned < GC_RATE && gc.partition < store->size() && gc.batches.size() < GC_MAX_BATCHES; ) {
+		StorageEngine &table = store->partition(gc.partition);
+		if (trees[gc.partition].held() || !table.next(gc.cursor, key, value)) {
+			if (!batch.keys.empty()) {
+				sendGcBatch(batch, msg);
+				batchSize = msg.transferSize();
+			}
+			gc.partition++;
+			gc.cursor = TableCursor();
+			continue;
+		}
+		scanned++;
+		size_t size = Message::pairSize(key, value);
+		if (batchSize + size > limit && !batch.keys.empty()) {
+			sendGcBatch(batch, msg);
+			batchSize = msg.transferSize();
+		}
+		batch.partition = gc.partition;
+		batch.keys.emplace_back(key, Entry::versionOf(value));
+		msg.pairs.emplace_back(key, value);
+		batchSize += size;
+	}
+	if (!batch.keys.empty())
+		sendGcBatch(batch, msg);
+}
+
+// sendGcBatch() pushes a garbage collection batch to the replicas of its range as an acked
+// refresh TRANSFER, then starts the next batch in batch and msg
+void MP2Node::sendGcBatch(GcBatch &batch, Message &msg){
+	ReplicaSet &replicas = replicaTable[batch.partition];
+	for (int i = 0; i < replicas.size(); i++)
+		batch.waiting.push_back(*replicas.at(i).getAddress());
+	batch.replicas = batch.waiting.size();
+	batch.held.assign(batch.keys.size(), 0);
+	batch.sentTime = par->getcurrtime();
+	sendTransfer(msg, batch.waiting);
+	gc.batches[msg.transID] = batch;
+	batch = GcBatch();
+	msg = Message(g_transID++, memberNode->addr, MessageType::TRANSFER, 0, 0);
+	msg.refresh = true;
+}
+
+// gcAcked() deletes the keys of a garbage collection batch that every replica it was pushed
+// to holds, once all of them acked it, unless a newer write replaced them meanwhile. The
+// other keys are kept for the next pass. A partition left empty gives its memory back.
+void MP2Node::gcAcked(int transID, Address &from, const string &held){
+	auto it = gc.batches.find(transID);
+	if (it == gc.batches.end())
+		return;
+	GcBatch &batch = it->second;
+	for (auto addr = batch.waiting.begin(); addr != batch.waiting.end(); addr++) {
+		if (RingDiff::sameAddress(*addr, from)) {
+			batch.waiting.erase(addr);
+			for (size_t i = 0; i < held.size() && i < batch.held.size(); i++)
+				batch.held[i] += held[i] == '1';
+			break;
+		}
+	}
+	if (!batch.waiting.empty())
+		return;
+	StorageEngine &table = store->partition(batch.partition);
+	size_t before = table.memoryUsed();
+	string_view stored;
+	for (size_t i = 0; i < batch.keys.size(); i++) {
+		auto &key = batch.keys[i];
+		if (batch.held[i] < batch.replicas)
+			continue;
+		if (table.find(key.first, stored) && Entry::versionOf(stored) == key.second && table.eraseIfPresent(key.first)) {
+			gc.passKeys++;
+			gc.totalKeys++;
+		}
+	}
+	if (table.isEmpty())
+		table.clear();
+	size_t reclaimed = before > table.memoryUsed() ? before - table.memoryUsed() : 0;
+	gc.passBytes += reclaimed;
+	gc.totalBytes += reclaimed;
+	gc.batches.erase(it);
+}
+
+// readRepair() pushes the newest entry of a successful read to the replicas that replied
+// with an older version or without the key. The push is a TRANSFER of the stabilization
+// protocol, which the replicas do not ack. Failed reads are not repaired, the key may have
+// been deleted on most replicas.
+void MP2Node::readRepair(TxStat *tx){
+	int votes;
+	string newest = tx->readValue(votes);
+	if (tx->sucCnt < tx->quorum || newest.empty())
+		return;
+	Message repair(SP_MSG, memberNode->addr, MessageType::TRANSFER, 0, 0);
+	repair.pairs.emplace_back(tx->key, newest);
+	string message = repair.toString();
+	for (auto &r : tx->readReplies)
+		if (r.second != newest)
+			sendMsg(&r.first, message);
+}
 
+// inRing() is true if the node owns tokens on the current ring
+bool MP2Node::inRing(Address &addr){
+	for (auto &node : ring)
+		if (*node.getAddress() == addr)
+			return true;
+	return false;
 }
 
 /**
@@ -599,30 +1056,110 @@ void MP2Node::updateTxMap(){
  * DESCRIPTION: Find the replicas of the given keyfunction
  * 				This function is responsible for finding the replicas of a key
  */
-vector<Node> MP2Node::findNodes(string key) {
-	size_t pos = hashFunction(key);
-	vector<Node> addr_vec;
-	if (ring.size() >= 3) {
-		// if pos <= min || pos > max, the leader is the min
-		if (pos <= ring.at(0).getHashCode() || pos > ring.at(ring.size()-1).getHashCode()) {
-			addr_vec.emplace_back(ring.at(0));
-			addr_vec.emplace_back(ring.at(1));
-			addr_vec.emplace_back(ring.at(2));
-		}
-		else {
-			// go through the ring until pos <= node
-			for (int i=1; i<ring.size(); i++){
-				Node addr = ring.at(i);
-				if (pos <= addr.getHashCode()) {
-					addr_vec.emplace_back(addr);
-					addr_vec.emplace_back(ring.at((i+1)%ring.size()));
-					addr_vec.emplace_back(ring.at((i+2)%ring.size()));
-					break;
-				}
-			}
+ReplicaSet MP2Node::findNodes(const string &key) {
+	return replicasAt(hashFunction(key));
+}
+
+/**
+ * FUNCTION NAME: replicasAt
+ *
+ * DESCRIPTION: Replicas responsible for a position on the ring. Used for client operations
+ * 				and for stabilization.
+ */
+const ReplicaSet& MP2Node::replicasAt(uint64_t pos) {
+	static ReplicaSet noReplicas;
+	if (replicaTable.empty())
+		return noReplicas; // ring not built yet
+	return replicaTable[tokenAt(pos)];
+}
+
+/**
+ * FUNCTION NAME: tokenAt
+ *
+ * DESCRIPTION: Index of the token leading a position: the first token with hash code >= pos,
+ * 				wrapping around to the min if pos > max. Only valid once the table is built.
+ */
+size_t MP2Node::tokenAt(uint64_t pos) {
+	size_t i = bucketFirst[pos >> bucketShift];
+	while (i < ringPos.size() && ringPos[i] < pos)
+		i++;
+	return i == ringPos.size() ? 0 : i;
+}
+
+/**
+ * FUNCTION NAME: rangeStart
+ *
+ * DESCRIPTION: The range of a token is (hash code of the previous token, its hash code]
+ */
+uint64_t MP2Node::rangeStart(size_t token) {
+	return ringPos[token == 0 ? ringPos.size() - 1 : token - 1];
+}
+
+/**
+ * FUNCTION NAME: buildReplicaTable
+ *
+ * DESCRIPTION: Precompute the replicas of every token: the token itself followed by the next
+ * 				tokens clockwise that belong to other physical nodes, and the bucket index used
+ * 				to find the leading token of a position. The store is split again into one
+ * 				partition per token. Called only when the ring changes.
+ */
+void MP2Node::buildReplicaTable() {
+	ringPos.resize(ring.size());
+	for (size_t i = 0; i < ring.size(); i++)
+		ringPos[i] = ring[i].getHashCode();
+	store->repartition(ringPos);
+
+	replicaTable.clear();
+	vector<ReplicaSet> tokenReplicas(ring.size(), ReplicaSet(&ring));
+	for (size_t t = 0; t < ring.size(); t++) {
+		for (size_t step = 0; step < ring.size() && tokenReplicas[t].size() < par->REPLICATION_FACTOR; step++) {
+			size_t i = (t + step) % ring.size();
+			if (!tokenReplicas[t].holds(ring[i]))
+				tokenReplicas[t].add(i);
 		}
+		if (tokenReplicas[t].size() < par->REPLICATION_FACTOR) {
+			trees.clear();
+			return; // not enough physical nodes yet
+		}
+	}
+	replicaTable.swap(tokenReplicas);
+
+	// about two buckets per token
+	int bits = 1;
+	while ((1ULL << bits) < 2 * ring.size())
+		bits++;
+	bucketShift = 64 - bits;
+	bucketFirst.resize(1ULL << bits);
+	size_t i = 0;
+	for (size_t b = 0; b < bucketFirst.size(); b++) {
+		uint64_t start = (uint64_t)b << bucketShift;
+		while (i < ringPos.size() && ringPos[i] < start)
+			i++;
+		bucketFirst[b] = i;
+	}
+	rebuildTrees();
+}
+
+/**
+ * FUNCTION NAME: ringSnapshot
+ *
+ * DESCRIPTION: Copy the token positions and replica addresses of the current ring, so it
+ * 				can be compared with the next one. Empty while the replica table is empty.
+ */
+RingSnapshot MP2Node::ringSnapshot() {
+	RingSnapshot snapshot;
+	if (replicaTable.empty())
+		return snapshot;
+	snapshot.pos = ringPos;
+	snapshot.replicas.resize(ring.size());
+	for (size_t t = 0; t < ring.size(); t++) {
+		ReplicaSet &replicas = replicaTable[t];
+		for (int i = 0; i < replicas.size(); i++)
+			snapshot.replicas[t].push_back(*replicas.at(i).getAddress());
+		if (ring[t].token == 0)
+			snapshot.nodes.push_back(*ring[t].getAddress());
 	}
-	return addr_vec;
+	return snapshot;
 }
 
 /**
@@ -660,26 +1197,495 @@ int MP2Node::enqueueWrapper(void *env, char *buff, int size) {
 
 
 void MP2Node::stabilizationProtocol() {
-	/*
-	 * Implement this
-	 */
-	// for each replica transfer over the entire hashtable. May not be as efficient as possible.
-	// call this function after assigning the new current membership list to the ring vector
-	// TODO: update hasReplicas vector as well.
-	for (const auto& x : this->ht->hashTable){
-		string key = x.first;
-		string value = x.second;
-		auto replicas = findNodes(key); // get the new replica nodes
-		for (auto&  idx : replicas){
-			// create stabilization protocol message which will not be confused with transaction messages
-			Message msg(SP_MSG, this->memberNode->addr, MessageType::CREATE, key, value);
-			string message = msg.toString(); // convert to string
-			// send over network
-			string toNode = (idx.getAddress())->getAddress();
-			// std::cout<<"sending stabilizationProtocol message : "<<message<<" for key: "<<key<< " and value: "
-			// <<value<<" to Node: "<<toNode<< " at time: "<< this->par->getcurrtime() <<std::endl;
-			emulNet->ENsend(&memberNode->addr, idx.getAddress(), message);
+	// only the ranges whose replica set changed are sent, and only to the replicas that did
+	// not hold them before. Moves are computed against the ring of the last finished
+	// rebalance, so a job cut short by another ring change is planned again in full.
+	RebalanceJob &job = rebalanceJob;
+	delete job.image;
+	job = RebalanceJob();
+	job.ring = ringSnapshot();
+	// the partitions were split again, garbage collection starts over once the ring settles
+	gc.batches.clear();
+	gc.partition = 0;
+	gc.cursor = TableCursor();
+	gc.passKeys = 0;
+	gc.passBytes = 0;
+	gc.ringChangeTime = par->getcurrtime();
+	job.transfers = RingDiff::diff(baseRing, job.ring);
+
+	// for each moved range decide once whether this node sends it and to whom. The sender is
+	// the first old replica still in the ring. When none is left, or the old ring had no
+	// replicas at all, every node holding keys of the range sends them.
+	job.targets.resize(job.transfers.size());
+	bool sending = false;
+	for (size_t t = 0; t < job.transfers.size(); t++) {
+		const RingTransfer &transfer = job.transfers[t];
+		const Address *sender = nullptr;
+		for (auto &addr : transfer.oldReplicas) {
+			if (job.ring.hasNode(addr)) {
+				sender = &addr;
+				break;
+			}
+		}
+		if (sender && !RingDiff::sameAddress(*sender, memberNode->addr))
+			continue;
+		for (auto &addr : transfer.newReplicas) {
+			bool had = false;
+			for (auto &old : transfer.oldReplicas)
+				had = had || RingDiff::sameAddress(old, addr);
+			if (!had && !RingDiff::sameAddress(addr, memberNode->addr))
+				job.targets[t].push_back(addr);
 		}
+		sending = sending || !job.targets[t].empty();
+	}
+	if (!sending || store->isEmpty()) {
+		baseRing = job.ring;
+		return;
+	}
+
+	// the partitions follow the new ring, so most lie whole in one moved range or in none and
+	// are sent or skipped without looking at their keys
+	job.plan.assign(store->size(), PARTITION_SKIP);
+	for (size_t p = 0; p < store->size(); p++) {
+		const RingRange &range = store->range(p);
+		for (size_t t = 0; t < job.transfers.size(); t++) {
+			if (job.targets[t].empty() || !job.transfers[t].range.overlaps(range))
+				continue;
+			if (job.plan[p] == PARTITION_SKIP && job.transfers[t].range.covers(range))
+				job.plan[p] = (int)t;
+			else
+				job.plan[p] = PARTITION_MIXED;
+		}
+	}
+
+	// keys of a range are batched into TRANSFER messages, one open batch per range
+	for (auto &transfer : job.transfers) {
+		job.batches.emplace_back(SP_MSG, memberNode->addr, MessageType::TRANSFER, transfer.range.start, transfer.range.end);
+		job.batchSize.push_back(job.batches.back().transferSize());
+	}
+	job.active = true;
+	job.startTime = par->getcurrtime();
+	job.totalKeys = store->currentSize();
+}
+
+// rebalance() sends the next slice of the running rebalance job, walking the partitions of
+// the store in ring order. A batch is sent once the next pair would not fit in a message
+// next to the gossip trailer, and the slice ends when the bytes sent this tick reach
+// REBALANCE_RATE.
+void MP2Node::rebalance(){
+	RebalanceJob &job = rebalanceJob;
+	if (!job.active)
+		return;
+	size_t limit = transferLimit();
+	size_t sent = 0;
+	string_view key, value;
+	while (sent < (size_t)par->REBALANCE_RATE && job.partition < store->size()) {
+		StorageEngine &table = store->partition(job.partition);
+		int plan = job.plan[job.partition];
+		// a large partition lying whole in a moved range is sent as an image of its keys
+		if (plan >= 0 && !job.cursor.started && (job.image || table.currentSize() >= IMAGE_MIN_KEYS)) {
+			if (sendImage(job.partition, (size_t)plan, sent))
+				job.partition++;
+			continue;
+		}
+		// a key may come twice when the table changes during the scan, the receivers
+		// ignore it as it is not newer
+		if (plan == PARTITION_SKIP || !table.next(job.cursor, key, value)) {
+			if (plan == PARTITION_SKIP)
+				job.scannedKeys += table.currentSize();
+			job.partition++;
+			job.cursor = TableCursor();
+			continue;
+		}
+		job.scannedKeys++;
+		size_t t = (size_t)plan;
+		if (plan == PARTITION_MIXED) {
+			const RingTransfer *transfer = RingDiff::find(job.transfers, hashFunction(key));
+			if (!transfer)
+				continue;
+			t = transfer - &job.transfers[0];
+			if (job.targets[t].empty())
+				continue;
+		}
+		size_t size = Message::pairSize(key, value);
+		if (job.batchSize[t] + size > limit && !job.batches[t].pairs.empty()) {
+			sent += sendTransfer(job.batches[t], job.targets[t]);
+			job.batches[t].pairs.clear();
+			job.batchSize[t] = job.batches[t].transferSize();
+		}
+		job.batches[t].pairs.emplace_back(key, value);
+		job.batchSize[t] += size;
+		job.sentKeys++;
+	}
+	job.sentBytes += sent;
+	if (job.partition < store->size()) {
+		if ((par->getcurrtime() - job.startTime) % REBALANCE_REPORT_PERIOD == 0)
+			rebalanceReport(false);
+		return;
+	}
+
+	// whole store scanned, send what is left of the open batches within the budget
+	bool pending = false;
+	for (size_t t = 0; t < job.batches.size(); t++) {
+		if (job.batches[t].pairs.empty())
+			continue;
+		if (sent >= (size_t)par->REBALANCE_RATE) {
+			pending = true;
+			continue;
+		}
+		size_t bytes = sendTransfer(job.batches[t], job.targets[t]);
+		sent += bytes;
+		job.sentBytes += bytes;
+		job.batches[t].pairs.clear();
+	}
+	if (!pending) {
+		job.active = false;
+		baseRing = job.ring;
+		rebalanceReport(true);
+	}
+}
+
+// sendImage() sends the next chunks of the image of a partition lying whole in a moved range,
+// writing the image first. Returns true once the last chunk is sent. When the image cannot
+// be written the partition falls back to TRANSFER batches.
+bool MP2Node::sendImage(size_t partition, size_t transfer, size_t &sent){
+	RebalanceJob &job = rebalanceJob;
+	if (!job.image) {
+		job.imageID = g_transID++;
+		string path = string(IMAGE_DIR) + "/" + memberNode->addr.getAddress() + "-out-" + to_string(job.imageID) + ".img";
+		job.image = new RangeImage();
+		if (!RangeImage::write(path, store->range(partition), store->partition(partition)) || !job.image->open(path)) {
+			delete job.image;
+			job.image = nullptr;
+			job.plan[partition] = PARTITION_MIXED;
+			return false;
+		}
+		job.imageSent = 0;
+	}
+	string_view contents = job.image->contents();
+	const RingRange &range = job.image->range();
+	Message chunk(job.imageID, memberNode->addr, MessageType::IMAGE, range.start, range.end);
+	chunk.imageSize = contents.size();
+	size_t room = transferLimit() - chunk.toString().size();
+	while (job.imageSent < contents.size() && sent < (size_t)par->REBALANCE_RATE) {
+		chunk.chunkOffset = job.imageSent;
+		chunk.value = string(contents.substr(job.imageSent, room));
+		sent += sendTransfer(chunk, job.targets[transfer]);
+		job.imageSent += chunk.value.size();
+	}
+	if (job.imageSent < contents.size())
+		return false;
+	job.scannedKeys += job.image->size();
+	job.sentKeys += job.image->size();
+	delete job.image;
+	job.image = nullptr;
+	return true;
+}
+
+// handleImage() writes a chunk of an image to its file. Once every byte arrived the image is
+// checked and serves reads right away, its keys are loaded into the store by loadImages.
+void MP2Node::handleImage(Message &msg){
+	int now = par->getcurrtime();
+	// a chunk reaching out of its image is dropped
+	if (msg.value.empty() || msg.chunkOffset > msg.imageSize || msg.value.size() > msg.imageSize - msg.chunkOffset)
+		return;
+	auto id = make_pair(msg.fromAddr.getAddress(), msg.transID);
+	auto it = downloads.find(id);
+	if (it == downloads.end()) {
+		string path = string(IMAGE_DIR) + "/" + memberNode->addr.getAddress() + "-" + id.first + "-" + to_string(id.second) + ".img";
+		int fd = RangeImage::create(path);
+		if (fd < 0)
+			return;
+		it = downloads.emplace(id, ImageDownload{path, fd, msg.imageSize, 0, {}, now, now}).first;
 	}
+	ImageDownload &download = it->second;
+	// so is one of an image of another size or already complete, and one received before is
+	// not counted again
+	if (msg.imageSize != download.size || download.fd < 0)
+		return;
+	download.lastTime = now;
+	if (download.chunks.count(msg.chunkOffset) ||
+			pwrite(download.fd, msg.value.data(), msg.value.size(), msg.chunkOffset) != (ssize_t)msg.value.size())
+		return;
+	download.chunks[msg.chunkOffset] = msg.value.size();
+	download.received += msg.value.size();
+	if (download.received < download.size)
+		return;
+	// chunks of other lengths may overlap, the image is whole once they leave no hole
+	uint64_t covered = 0;
+	for (auto &chunk : download.chunks) {
+		if (chunk.first > covered)
+			return;
+		covered = max(covered, chunk.first + chunk.second);
+	}
+	if (covered < download.size)
+		return;
+	// the download stays, closed, until it times out so late copies of its chunks are ignored
+	close(download.fd);
+	download.fd = -1;
+	download.chunks.clear();
+	RangeImage *image = new RangeImage();
+	if (image->open(download.path)) {
+		log->LOG(&memberNode->addr, "#STATSLOG# image of %lu keys %lu bytes from %s received in %d ticks, serving reads",
+			image->size(), (unsigned long)download.size, id.first.c_str(), now - download.startTime + 1);
+		loads.push_back(ImageLoad{image, 0, {}, now});
+	}
+	else
+		delete image;
+}
+
+// loadImages() drops the images whose chunks stopped coming and loads IMAGE_LOAD_RATE keys of
+// the received ones into the store, last write wins against what the store got meanwhile
+void MP2Node::loadImages(){
+	int now = par->getcurrtime();
+	for (auto it = downloads.begin(); it != downloads.end();) {
+		if (now - it->second.lastTime > IMAGE_TIMEOUT) {
+			if (it->second.fd >= 0) {
+				close(it->second.fd);
+				unlink(it->second.path.c_str());
+			}
+			it = downloads.erase(it);
+		}
+		else
+			it++;
+	}
+	size_t budget = IMAGE_LOAD_RATE;
+	while (budget > 0 && !loads.empty()) {
+		ImageLoad &load = loads.front();
+		string_view key, value;
+		for (; budget > 0 && load.next < load.image->size(); budget--) {
+			load.image->record(load.next++, key, value);
+			if (!load.deleted.count(key) && !expired(value))
+				store->upsert(key, value);
+		}
+		if (load.next < load.image->size())
+			return;
+		log->LOG(&memberNode->addr, "#STATSLOG# image of %lu keys loaded in %d ticks", load.image->size(), now - load.receivedTime + 1);
+		delete load.image;
+		loads.erase(loads.begin());
+	}
+}
+
+// findEntry() the newest entry of key, in the store or in a received image, tombstones included
+bool MP2Node::findEntry(const string &key, string_view &stored){
+	string_view imaged;
+	bool found = store->find(key, stored);
+	if (imageFind(key, imaged) && (!found || Entry::versionOf(imaged) > Entry::versionOf(stored))) {
+		stored = imaged;
+		found = true;
+	}
+	return found;
+}
+
+// imageFind() the newest entry of key in the received images still being loaded
+bool MP2Node::imageFind(const string &key, string_view &stored){
+	bool found = false;
+	uint64_t pos = hashFunction(key);
+	for (auto &load : loads) {
+		string_view value;
+		if (!load.image->range().contains(pos) || load.deleted.count(key) || !load.image->find(key, value) || expired(value))
+			continue;
+		if (!found || Entry::versionOf(value) > Entry::versionOf(stored)) {
+			stored = value;
+			found = true;
+		}
+	}
+	return found;
+}
+
+// expired() tells if a stored entry has a time to live that ran out
+bool MP2Node::expired(string_view stored){
+	uint64_t expiresAt = Entry::expiryOf(stored);
+	return expiresAt && expiresAt <= (uint64_t)par->getcurrtime();
+}
+
+// expireKeys() erases the keys whose time to live ran out this tick. Every replica expires
+// its copy on its own clock, no delete is sent. A timer whose key was written again since
+// or erased is stale and is dropped, only the timer of the stored expiry erases the key.
+void MP2Node::expireKeys(){
+	vector<pair<string, uint64_t>> fired;
+	expiries.advance(par->getcurrtime(), fired);
+	unsigned long erased = 0;
+	for (auto &timer : fired) {
+		string_view stored;
+		if (store->find(timer.first, stored) && Entry::expiryOf(stored) == timer.second && store->eraseIfPresent(timer.first))
+			erased++;
+	}
+	if (erased > 0)
+		log->LOG(&memberNode->addr, "#STATSLOG# expired %lu keys, %zu expiries pending", erased, expiries.size());
+}
+
+// rebalanceReport() writes the progress of the rebalance job and its ETA to stats.log
+void MP2Node::rebalanceReport(bool done){
+	RebalanceJob &job = rebalanceJob;
+	int elapsed = par->getcurrtime() - job.startTime + 1;
+	if (done) {
+		log->LOG(&memberNode->addr, "#STATSLOG# rebalance done in %d ticks: %lu keys scanned, %lu keys %lu bytes sent",
+			elapsed, job.scannedKeys, job.sentKeys, job.sentBytes);
+		return;
+	}
+	// the table may have grown since the start, the remaining keys are an estimate
+	unsigned long left = job.totalKeys > job.scannedKeys ? job.totalKeys - job.scannedKeys : 0;
+	double rate = (double)job.scannedKeys / elapsed;
+	long eta = rate > 0 ? (long)ceil(left / rate) : -1;
+	log->LOG(&memberNode->addr, "#STATSLOG# rebalance: %lu/%lu keys scanned, %lu keys %lu bytes sent, ETA %ld ticks",
+		job.scannedKeys, job.totalKeys, job.sentKeys, job.sentBytes, eta);
+}
+
+// sendTransfer() sends a batch of keys to each of the targets, returns the bytes sent
+size_t MP2Node::sendTransfer(Message &batch, const vector<Address> &targets){
+	string message = batch.toString();
+	for (auto addr : targets)
+		sendMsg(&addr, message);
+	return message.size() * targets.size();
+}
+
+// transferLimit() is the max size of a TRANSFER message that still leaves room for the gossip trailer
+size_t MP2Node::transferLimit(){
+	return par->MAX_MSG_SIZE - sizeof(en_msg) - GOSSIP_MAX_ENTRIES * Gossip::ENTRY_SIZE - Gossip::FOOTER_SIZE - 1;
+}
+
+// rebuildTrees() recomputes the hash trees of the ranges this node holds after a ring change
+void MP2Node::rebuildTrees(){
+	trees.assign(ring.size(), MerkleTree());
+	for (size_t t = 0; t < ring.size(); t++)
+		if (replicaTable[t].holds(Node(memberNode->addr, 0)))
+			trees[t].reset();
+	for (size_t t = 0; t < ring.size(); t++) {
+		if (!trees[t].held())
+			continue;
+		store->partition(t).forEach([this, t](string_view key, string_view value) {
+			merkleChange(t, key, nullptr, &value);
+		});
+	}
+}
+
+// merkleChange() applies a change of the partition of a token range to the tree of the range
+void MP2Node::merkleChange(size_t token, string_view key, const string_view *oldValue, const string_view *newValue){
+	if (token >= trees.size() || !trees[token].held())
+		return;
+	MerkleTree &tree = trees[token];
+	uint64_t pos = hashFunction(key);
+	if (oldValue)
+		tree.toggle(pos, MerkleTree::entryHash(key, *oldValue));
+	if (newValue)
+		tree.toggle(pos, MerkleTree::entryHash(key, *newValue));
+}
+
+// antiEntropy() periodically sends the root of every range this node is the primary of to
+// the other replicas. They answer with the children of the nodes that differ, down to the
+// leaves, see handleMerkle().
+void MP2Node::antiEntropy(){
+	if (trees.empty())
+		return;
+	syncRecovered();
+	int id = *(int *)(&memberNode->addr.addr);
+	if ((par->getcurrtime() + id) % ANTI_ENTROPY_PERIOD != 0)
+		return;
+	Node self(memberNode->addr, 0);
+	for (size_t t = 0; t < ring.size(); t++) {
+		if (!ring[t].samePhysicalNode(self))
+			continue;
+		Message msg(SP_MSG, memberNode->addr, MessageType::MERKLE, rangeStart(t), ringPos[t]);
+		msg.digests.emplace_back(1, trees[t].hashAt(1));
+		string message = msg.toString();
+		ReplicaSet &replicas = replicaTable[t];
+		for (int i = 1; i < replicas.size(); i++)
+			sendMsg(replicas.at(i).getAddress(), message);
+	}
+}
+
+// syncRecovered() fetches what a node recovered from disk missed while it was down: it
+// compares the roots of all the ranges it holds with the other replicas right away, which
+// exchanges only the leaves that differ, instead of waiting for the primaries to do it
+void MP2Node::syncRecovered(){
+	if (!recoverySync)
+		return;
+	recoverySync = false;
+	for (size_t t = 0; t < ring.size(); t++) {
+		if (!trees[t].held())
+			continue;
+		Message msg(SP_MSG, memberNode->addr, MessageType::MERKLE, rangeStart(t), ringPos[t]);
+		msg.digests.emplace_back(1, trees[t].hashAt(1));
+		string message = msg.toString();
+		ReplicaSet &replicas = replicaTable[t];
+		for (int i = 0; i < replicas.size(); i++)
+			if (!replicas.at(i).samePhysicalNode(Node(memberNode->addr, 0)))
+				sendMsg(replicas.at(i).getAddress(), message);
+	}
+}
+
+// handleMerkle() compares tree nodes received from another replica of a range. Differing
+// inner nodes are answered with our hashes of their children. Differing leaves are repaired
+// both ways: our keys of the leaves are pushed and the sender is asked for its keys with a
+// pull request, which is answered with keys only, so the exchange always ends at the leaves.
+// The pushed keys, tombstones included, only replace older versions of keys the receiver
+// holds, see sendLeaves().
+void MP2Node::handleMerkle(Message &msg){
+	if (trees.empty())
+		return;
+	size_t t = tokenAt(msg.rangeEnd);
+	// ignore ranges the two rings do not agree on yet
+	if (ringPos[t] != msg.rangeEnd || rangeStart(t) != msg.rangeStart || !trees[t].held())
+		return;
+	MerkleTree &tree = trees[t];
+	vector<int> leaves;
+	if (msg.pull) {
+		for (auto &d : msg.digests)
+			if (MerkleTree::validIndex(d.first) && MerkleTree::isLeaf(d.first))
+				leaves.push_back(d.first);
+		sendLeaves(t, leaves, &msg.fromAddr);
+		return;
+	}
+	Message reply(SP_MSG, memberNode->addr, MessageType::MERKLE, msg.rangeStart, msg.rangeEnd);
+	Message pull(SP_MSG, memberNode->addr, MessageType::MERKLE, msg.rangeStart, msg.rangeEnd);
+	pull.pull = true;
+	for (auto &d : msg.digests) {
+		int i = d.first;
+		if (!MerkleTree::validIndex(i) || tree.hashAt(i) == d.second)
+			continue;
+		if (MerkleTree::isLeaf(i)) {
+			leaves.push_back(i);
+			pull.digests.emplace_back(i, 0);
+		} else {
+			reply.digests.emplace_back(2 * i, tree.hashAt(2 * i));
+			reply.digests.emplace_back(2 * i + 1, tree.hashAt(2 * i + 1));
+		}
+	}
+	if (!reply.digests.empty())
+		sendMsg(&msg.fromAddr, reply.toString());
+	if (!leaves.empty()) {
+		sendLeaves(t, leaves, &msg.fromAddr);
+		sendMsg(&msg.fromAddr, pull.toString());
+	}
+}
+
+// sendLeaves() pushes the keys of some leaves of a range's tree in TRANSFER batches, in one
+// pass over the partition. They are written last write wins, so a replica that missed a
+// CREATE gets the key, and the tombstones pushed along keep a deleted key from coming back
+// for TOMBSTONE_GRACE ticks.
+void MP2Node::sendLeaves(size_t token, const vector<int> &leaves, Address *toaddr){
+	vector<Address> to(1, *toaddr);
+	RingRange range = {rangeStart(token), ringPos[token]};
+	Message batch(SP_MSG, memberNode->addr, MessageType::TRANSFER, range.start, range.end);
+	size_t limit = transferLimit();
+	size_t batchSize = batch.transferSize();
+	vector<bool> wanted(2 * MerkleTree::LEAVES, false);
+	for (int leaf : leaves)
+		wanted[leaf] = true;
+	store->partition(token).forEach([&](string_view key, string_view value) {
+		if (!wanted[MerkleTree::leafOf(hashFunction(key))])
+			return;
+		size_t size = Message::pairSize(key, value);
+		if (batchSize + size > limit && !batch.pairs.empty()) {
+			sendTransfer(batch, to);
+			batch.pairs.clear();
+			batchSize = batch.transferSize();
+		}
+		batch.pairs.emplace_back(key, value);
+		batchSize += size;
+	});
+	if (!batch.pairs.empty())
+		sendTransfer(batch, to);
 }
 
@@ -13,11 +13,50 @@
 #include "stdincludes.h"
 #include "EmulNet.h"
 #include "Node.h"
-#include "HashTable.h"
+#include "RangeStore.h"
+#include "Entry.h"
+#include "Persistence.h"
+#include "RangeImage.h"
+#include "TimerWheel.h"
 #include "Log.h"
 #include "Params.h"
 #include "Message.h"
 #include "Queue.h"
+#include "Gossip.h"
+#include "RingDiff.h"
+#include "MerkleTree.h"
+#include <set>
+
+// ticks between two Merkle tree exchanges of a range
+#define ANTI_ENTROPY_PERIOD 20
+// ticks between two progress reports of a rebalance job
+#define REBALANCE_REPORT_PERIOD 10
+// ticks between two replays of the hints kept for replicas that missed writes
+#define HINT_REPLAY_PERIOD 5
+// max number of hints a coordinator keeps, later ones are dropped
+#define MAX_HINTS 10000
+// a replica that did not ack its hints waits up to 2^HINT_MAX_BACKOFF replay periods for the next replay
+#define HINT_MAX_BACKOFF 4
+// rebalance plan of a partition none of whose keys this node sends
+#define PARTITION_SKIP -1
+// rebalance plan of a partition split between moved ranges, its keys are looked up one by one
+#define PARTITION_MIXED -2
+// ticks after a ring change before keys of ranges this node left are collected
+#define GC_DELAY 10
+// keys the garbage collection sweep looks at per tick
+#define GC_RATE 256
+// collection batches waiting for acks at any time
+#define GC_MAX_BATCHES 8
+// ticks after which a collection batch missing acks is given up, its keys are kept
+#define GC_ACK_TIMEOUT 10
+// keys a partition sent whole needs to be sent as an image, smaller ones go in TRANSFER batches
+#define IMAGE_MIN_KEYS 256
+// keys of received images loaded into the store per tick
+#define IMAGE_LOAD_RATE 1024
+// ticks without a chunk after which an image being received is dropped, anti-entropy repairs its range
+#define IMAGE_TIMEOUT 20
+// ticks a tombstone is kept before it is purged, for anti-entropy to carry the delete to every replica
+#define TOMBSTONE_GRACE (5 * ANTI_ENTROPY_PERIOD)
 
 const int SP_MSG = -1; // indicates message is from stabilization protocol (running in  background) and not client operation
 
@@ -37,21 +76,152 @@ public:
 	
 	int repCnt;
 	int sucCnt;
+	int replicas; // replicas the request went to
+	int quorum; // successful replies needed
+	bool logged; // outcome already logged, the tx stays until every replica replied or it times out
+	vector<Address> pending; // replicas that have not replied yet
+	vector<pair<Address, string>> readReplies; // (replica, encoded Entry) of every read reply, "" if it misses the key
+	uint64_t version; // version of the value written by a create or update
+	uint64_t expiresAt; // tick the value written expires at, 0 if it never does
 	string key;
 	string value;
 	MessageType mT;
 	// constructor
-	TxStat(int id, int timestamp, MessageType mT, string key, string value){
+	TxStat(int id, int timestamp, MessageType mT, string key, string value, int replicas, int quorum){
 		this->id = id;
 		this->timestamp = timestamp;
 		this->repCnt = 0;
 		this->sucCnt = 0;
+		this->replicas = replicas;
+		this->quorum = quorum;
 		this->mT = mT;
 		this->key = key;
 		this->value = value;
+		this->logged = false;
+		this->version = 0;
+		this->expiresAt = 0;
 	}
 	int getTimestamp(){ return timestamp;}
+	// newest entry among the read replies, encoded, and how many replies returned that version
+	string readValue(int &votes){
+		string best;
+		votes = 0;
+		for (auto &r : readReplies)
+			if (!r.second.empty() && (best.empty() || Entry::versionOf(r.second) > Entry::versionOf(best)))
+				best = r.second;
+		for (auto &r : readReplies)
+			votes += !best.empty() && r.second == best;
+		return best;
+	}
+	void replied(Address &addr){
+		for (auto it = pending.begin(); it != pending.end(); it++)
+			if (*it == addr) {
+				pending.erase(it);
+				return;
+			}
+	}
 };
+// replicas of a key as indices into the ring, primary first, at most MAX_REPLICAS of them. Kept in a fixed size array so
+// looking up replicas on every client operation and every key during stabilization does not
+// allocate or copy Node objects. Only valid until the ring changes.
+class ReplicaSet {
+	vector<Node> *ring;
+	int idx[MAX_REPLICAS];
+	int cnt;
+public:
+	ReplicaSet(vector<Node> *ring = nullptr): ring(ring), cnt(0) {}
+	void add(int i){ idx[cnt++] = i; }
+	void clear(){ cnt = 0; }
+	int size(){ return cnt; }
+	int index(int i){ return idx[i]; }
+	Node& at(int i){ return ring->at(idx[i]); }
+	bool holds(const Node &node){
+		for (int i = 0; i < cnt; i++)
+			if (ring->at(idx[i]).samePhysicalNode(node))
+				return true;
+		return false;
+	}
+};
+
+// background job that streams the keys of the ranges moved by a ring change to their new
+// replicas, a slice of at most REBALANCE_RATE bytes per tick. The cursor is the position
+// of the scan in the partition being scanned.
+struct RebalanceJob {
+	bool active;
+	// ring the keys are moved to
+	RingSnapshot ring;
+	vector<RingTransfer> transfers;
+	// new replicas this node sends each moved range to, empty if another node sends it
+	vector<vector<Address>> targets;
+	// open TRANSFER batch of each moved range and its serialized size
+	vector<Message> batches;
+	vector<size_t> batchSize;
+	// per partition of the store the moved range it lies in whole, PARTITION_SKIP or PARTITION_MIXED
+	vector<int> plan;
+	// partition being scanned and the position in it
+	size_t partition;
+	TableCursor cursor;
+	// image of the partition being sent whole, its transfer id and the bytes of it sent
+	RangeImage *image;
+	int imageID;
+	size_t imageSent;
+	int startTime;
+	unsigned long totalKeys;
+	unsigned long scannedKeys;
+	unsigned long sentKeys;
+	unsigned long sentBytes;
+	RebalanceJob(): active(false), partition(0), image(nullptr), imageID(0), imageSent(0), startTime(0), totalKeys(0), scannedKeys(0), sentKeys(0), sentBytes(0) {}
+};
+
+// image of a range being received from another node, written to its file chunk by chunk
+struct ImageDownload {
+	string path;
+	int fd;
+	uint64_t size;
+	// bytes of the chunks written, each counted once, and the length of each by offset. fd is
+	// -1 once the image is complete
+	uint64_t received;
+	map<uint64_t, uint64_t> chunks;
+	int startTime;
+	int lastTime;
+};
+
+// received image, it serves the reads of its range while its keys are loaded into the store
+struct ImageLoad {
+	RangeImage *image;
+	size_t next;
+	// keys deleted since the image arrived, neither served nor loaded
+	set<string, less<>> deleted;
+	int receivedTime;
+};
+
+// keys of a range this node left, pushed to the replicas of the range and deleted once all
+// of them acked holding it. A key is only deleted if it still has the version that was pushed.
+struct GcBatch {
+	size_t partition;
+	vector<pair<string, uint64_t>> keys;
+	// replicas the batch went to, those yet to ack it, and how many of them hold each key
+	int replicas;
+	vector<Address> waiting;
+	vector<int> held;
+	int sentTime;
+};
+
+// background sweep over the partitions of ranges this node is no longer a replica of, at
+// most GC_RATE keys per tick. A pass starts only once no batch of the last one is waiting.
+struct GcSweep {
+	size_t partition;
+	TableCursor cursor;
+	// batches waiting for acks by transID
+	map<int, GcBatch> batches;
+	int ringChangeTime;
+	unsigned long passKeys;
+	size_t passBytes;
+	unsigned long totalKeys;
+	size_t totalBytes;
+	GcSweep(): partition(0), ringChangeTime(0), passKeys(0), passBytes(0), totalKeys(0), totalBytes(0) {}
+};
+
 /**
  * CLASS NAME: MP2Node
  *
@@ -70,8 +240,35 @@ private:
 	vector<Node> haveReplicasOf;
 	// Ring
 	vector<Node> ring;
-	// Hash Table
-	HashTable * ht;
+	// hash code of every node in the ring, same order as ring
+	vector<uint64_t> ringPos;
+	// replicas of every token on the ring, same order as ring, rebuilt when the ring changes
+	vector<ReplicaSet> replicaTable;
+	// the hash space is cut into equal buckets by its top bits, each bucket remembers the
+	// first token at or after its start so a lookup only scans the few tokens inside it
+	vector<size_t> bucketFirst;
+	int bucketShift;
+	// ring the last finished rebalance moved the keys to, diffed with the new ring to find
+	// what moved
+	RingSnapshot baseRing;
+	RebalanceJob rebalanceJob;
+	GcSweep gc;
+	// images being received by (sender address, transfer id), and those being loaded
+	map<pair<string, int>, ImageDownload> downloads;
+	vector<ImageLoad> loads;
+	// expiry of every stored key written with a time to live
+	TimerWheel expiries;
+	// hash tree of every token range this node is a replica of, same order as ring, the
+	// trees of the other ranges are left empty
+	vector<MerkleTree> trees;
+	// local key value store, one partition per token range in ring order
+	RangeStore * store;
+	// on disk copy of the store when PERSIST is set, nullptr otherwise
+	Persistence * persist;
+	// replies to writes held until the writes are committed to disk at the end of the tick
+	vector<pair<Address, string>> heldReplies;
+	// the store was recovered from disk, compare it with the other replicas once the ring is known
+	bool recoverySync;
 	// Member representing this member
 	Member *memberNode;
 	// Params object
@@ -83,8 +280,22 @@ private:
 	// in-flight transactions
 	//<tx_id, tx_obj>
 	map<int, TxStat*> txMap;
+	// tick of the last write coordinated here and how many were coordinated in it, see Entry::makeVersion
+	int versionTime;
+	int versionSequence;
 	//<tx_id, is_complete?>
 	//map<int, bool> txDn;
+	// writes that replicas missed, kept by the coordinator until the replica acks them
+	// <replica address, <key, value>>
+	map<string, map<string, string>> hints;
+	// hint batches sent in the last replay and not acked yet <transID, (replica address, pairs)>
+	map<int, pair<string, vector<pair<string, string>>>> hintBatches;
+	// number of hints kept, and per replica the replays it missed in a row and the time of the next one
+	size_t hintCount;
+	map<string, pair<int, int>> hintBackoff;
+	// membership delta piggybacked on outgoing messages, rebuilt once per tick
+	string gossipTrailer;
+	long gossipTrailerTime;
 
 
 public:
@@ -96,13 +307,18 @@ public:
 	// ring functionalities
 	void updateRing();
 	vector<Node> getMembershipList();
-	size_t hashFunction(string key);
+	uint64_t hashFunction(string_view key);
+	void buildReplicaTable();
+	const ReplicaSet& replicasAt(uint64_t pos);
+	size_t tokenAt(uint64_t pos);
+	uint64_t rangeStart(size_t token);
+	RingSnapshot ringSnapshot();
 	void findNeighbors();
 
 	// client side CRUD APIs
-	void clientCreate(string key, string value);
+	void clientCreate(string key, string value, int ttl = 0);
 	void clientRead(string key);
-	void clientUpdate(string key, string value);
+	void clientUpdate(string key, string value, int ttl = 0);
 	void clientDelete(string key);
 
 	// receive messages from Emulnet
@@ -116,14 +332,14 @@ public:
 	void dispatchMessages(Message message);
 
 	// find the addresses of nodes that are responsible for a key
-	vector<Node> findNodes(string key);
+	ReplicaSet findNodes(const string &key);
 
 	// server
 	// also add txId for logging right where we update the hash table
-	bool createKeyValue(string key, string value, ReplicaType replica, int txId);
+	bool createKeyValue(string key, string value, ReplicaType replica, int txId, uint64_t version, uint64_t expiresAt = 0);
 	string readKey(string key, int txId);
-	bool updateKeyValue(string key, string value, ReplicaType replica, int txId);
-	bool deletekey(string key, int txId);
+	bool updateKeyValue(string key, string value, ReplicaType replica, int txId, uint64_t version, uint64_t expiresAt = 0);
+	bool deletekey(string key, int txId, uint64_t version);
 
 	// stabilization protocol - handle multiple failures
 	void stabilizationProtocol();
@@ -134,11 +350,40 @@ public:
 	//Own functions
 	//reply from server to client
 	void sendreply(string key, MessageType mT, bool success, Address* fromaddr, int txID, string content = ""); 
-    Message makeMsg(MessageType mT, string key, string value = "");
-    void makeTx(int txId, MessageType mT, string key, string value = "");
-    void srvReply(MessageType mT, Address* fromaddr, int txId, bool success, string data = "");
+    Message makeMsg(MessageType mT, string key, string value = "", int ttl = 0);
+    void makeTx(int txId, MessageType mT, string key, string value = "", int ttl = 0);
+    void srvReply(MessageType mT, Address* fromaddr, int txId, bool success, string data = "", uint64_t version = 0, uint64_t expiresAt = 0);
     void clientLog(TxStat* tx, bool isCoordinator, bool success, int transID);
     void updateTxMap();
+    void sendMsg(Address *toaddr, string message);
+    size_t sendTransfer(Message &batch, const vector<Address> &targets);
+    void rebalance();
+    void rebalanceReport(bool done);
+    bool sendImage(size_t partition, size_t transfer, size_t &sent);
+    void handleImage(Message &msg);
+    void loadImages();
+    bool imageFind(const string &key, string_view &stored);
+    bool findEntry(const string &key, string_view &stored);
+    bool expired(string_view stored);
+    void expireKeys();
+    size_t transferLimit();
+    void rebuildTrees();
+    void merkleChange(size_t token, string_view key, const string_view *oldValue, const string_view *newValue);
+    void antiEntropy();
+    void handleMerkle(Message &msg);
+    void sendLeaves(size_t token, const vector<int> &leaves, Address *toaddr);
+    void addHint(Address &target, const string &key, const string &value);
+    void replayHints();
+    void hintAcked(int transID);
+    void collectGarbage();
+    void persistTick();
+    void syncRecovered();
+    void sendGcBatch(GcBatch &batch, Message &msg);
+    void gcAcked(int transID, Address &from, const string &held);
+    bool inRing(Address &addr);
+    void readRepair(TxStat *tx);
+    unsigned long keyCount();
+    size_t storeBytes();
 };
 
 #endif /* MP2NODE_H_ */
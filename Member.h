@@ -106,12 +106,16 @@ public:
 	int timeOutCounter;
 	// Membership table
 	vector<MemberListEntry> memberList;
+	// Members removed as failed in the last GOSSIP_FAILED_TICKS ticks, stamped with the time of removal
+	vector<MemberListEntry> failedList;
 	// My position in the membership table
 	vector<MemberListEntry>::iterator myPos;
 	// Queue for failure detection messages
 	queue<q_elt> mp1q;
 	// Queue for KVstore messages
 	queue<q_elt> mp2q;
+	// Last time the membership delta was piggybacked on KVstore traffic to a peer <address, time>
+	map<string, long> piggybacked;
 	/**
 	 * Constructor
 	 */
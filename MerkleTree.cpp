@@ -0,0 +1,42 @@
+/**********************************
+ * FILE NAME: MerkleTree.cpp
+ *
+ * DESCRIPTION: MerkleTree class definition
+ **********************************/
+
+#include "MerkleTree.h"
+
+/**
+ * FUNCTION NAME: reset
+ *
+ * DESCRIPTION: Make the tree the tree of an empty range
+ */
+void MerkleTree::reset() {
+	nodes.assign(2 * LEAVES, 0);
+	for ( int i = LEAVES - 1; i >= 1; i-- ) {
+		nodes[i] = hash64(&nodes[2 * i], 2 * sizeof(uint64_t));
+	}
+}
+
+/**
+ * FUNCTION NAME: toggle
+ *
+ * DESCRIPTION: Add or remove (XOR is its own inverse) the hash of a pair at ring position
+ * 				pos, and rehash the path from its leaf to the root
+ */
+void MerkleTree::toggle(uint64_t pos, uint64_t entry) {
+	int i = leafOf(pos);
+	nodes[i] ^= entry;
+	for ( i /= 2; i >= 1; i /= 2 ) {
+		nodes[i] = hash64(&nodes[2 * i], 2 * sizeof(uint64_t));
+	}
+}
+
+/**
+ * FUNCTION NAME: entryHash
+ *
+ * DESCRIPTION: Hash of a (key,value) pair as stored in the leaves
+ */
+uint64_t MerkleTree::entryHash(string_view key, string_view value) {
+	return hash64(value.data(), value.size(), hash64(key.data(), key.size()));
+}
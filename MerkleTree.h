@@ -0,0 +1,46 @@
+/**********************************
+ * FILE NAME: MerkleTree.h
+ *
+ * DESCRIPTION: Header file of MerkleTree class
+ **********************************/
+
+#ifndef MERKLETREE_H_
+#define MERKLETREE_H_
+
+#include "stdincludes.h"
+#include "Hash.h"
+#include <string_view>
+
+/**
+ * Macros
+ */
+// levels below the root, the tree has 1 << MERKLE_DEPTH leaves
+#define MERKLE_DEPTH 6
+
+/**
+ * CLASS NAME: MerkleTree
+ *
+ * DESCRIPTION: Hash tree over the keys of one range of the ring. A key goes to the leaf
+ * 				picked by the low bits of its ring position, the same leaf on every replica.
+ * 				A leaf is the XOR of the hashes of its (key,value) pairs, so it is updated in
+ * 				place when a pair is added or removed, and every inner node hashes its two
+ * 				children. Nodes are numbered in heap order: 1 is the root, the children of
+ * 				i are 2i and 2i+1 and the leaves are LEAVES..2*LEAVES-1.
+ */
+class MerkleTree {
+	vector<uint64_t> nodes;
+public:
+	static const int LEAVES = 1 << MERKLE_DEPTH;
+
+	void reset();
+	bool held() const { return !nodes.empty(); }
+	uint64_t hashAt(int idx) const { return nodes[idx]; }
+	void toggle(uint64_t pos, uint64_t entry);
+
+	static int leafOf(uint64_t pos) { return LEAVES + (int)(pos & (LEAVES - 1)); }
+	static bool isLeaf(int idx) { return idx >= LEAVES; }
+	static bool validIndex(int idx) { return idx >= 1 && idx < 2 * LEAVES; }
+	static uint64_t entryHash(string_view key, string_view value);
+};
+
+#endif /* MERKLETREE_H_ */
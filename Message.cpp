@@ -8,14 +8,27 @@
 /**
  * Constructor
  */
-// transID::fromAddr::CREATE::key::value::ReplicaType
+// transID::fromAddr::CREATE::key::value::ReplicaType::version::expiresAt
 // transID::fromAddr::READ::key
-// transID::fromAddr::UPDATE::key::value::ReplicaType
-// transID::fromAddr::DELETE::key
-// transID::fromAddr::REPLY::sucess
-// transID::fromAddr::READREPLY::value
+// transID::fromAddr::UPDATE::key::value::ReplicaType::version::expiresAt
+// transID::fromAddr::DELETE::key::version
+// transID::fromAddr::REPLY::sucess[::held]
+// transID::fromAddr::READREPLY::value::version::expiresAt
+// transID::fromAddr::TRANSFER::rangeStart rangeEnd refresh count [keyLen key valueLen value]...
+// transID::fromAddr::MERKLE::rangeStart rangeEnd pull count [node hash]...
+// transID::fromAddr::IMAGE::rangeStart rangeEnd imageSize chunkOffset [chunk]
+// the body of a transfer, merkle or image is binary, fixed size integers and length prefixed strings
 Message::Message(string message){
 	this->delimiter = "::";
+	version = 0;
+	expiresAt = 0;
+	// a short or corrupt body leaves these as the range constructor does
+	pull = false;
+	refresh = false;
+	imageSize = 0;
+	chunkOffset = 0;
+	rangeStart = 0;
+	rangeEnd = 0;
 	vector<string> tuple;
 	size_t pos = message.find(delimiter);
 	size_t start = 0;
@@ -23,6 +36,9 @@ Message::Message(string message){
 		string field = message.substr(start, pos-start);
 		tuple.push_back(field);
 		start = pos + 2;
+		// the transfer body may contain the delimiter, stop at the header
+		if (tuple.size() == 3 && (stoi(tuple.at(2)) == TRANSFER || stoi(tuple.at(2)) == MERKLE || stoi(tuple.at(2)) == IMAGE))
+			break;
 		pos = message.find(delimiter, start);
 	}
 	tuple.push_back(message.substr(start));
@@ -38,20 +54,101 @@ Message::Message(string message){
 			value = tuple.at(4);
 			if (tuple.size() > 5)
 				replica = static_cast<ReplicaType>(stoi(tuple.at(5)));
+			if (tuple.size() > 6)
+				version = stoull(tuple.at(6));
+			if (tuple.size() > 7)
+				expiresAt = stoull(tuple.at(7));
 			break;
 		case READ:
+			key = tuple.at(3);
+			break;
 		case DELETE:
 			key = tuple.at(3);
+			if (tuple.size() > 4)
+				version = stoull(tuple.at(4));
 			break;
 		case REPLY:
 			if (tuple.at(3) == "1")
 				success = true;
 			else
 				success = false;
+			if (tuple.size() > 4)
+				value = tuple.at(4);
 			break;
 		case READREPLY:
 			value = tuple.at(3);
+			if (tuple.size() > 4)
+				version = stoull(tuple.at(4));
+			if (tuple.size() > 5)
+				expiresAt = stoull(tuple.at(5));
 			break;
+		case TRANSFER:{
+			const string &body = tuple.at(3);
+			const char *buf = body.data();
+			const char *end = buf + body.size();
+			uint32_t count = 0;
+			if (body.size() < 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t))
+				break;
+			memcpy(&rangeStart, buf, sizeof(uint64_t));
+			memcpy(&rangeEnd, buf + sizeof(uint64_t), sizeof(uint64_t));
+			refresh = buf[2 * sizeof(uint64_t)] != 0;
+			memcpy(&count, buf + 2 * sizeof(uint64_t) + 1, sizeof(uint32_t));
+			buf += 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t);
+			pairs.reserve(count);
+			for (uint32_t i = 0; i < count; i++) {
+				uint32_t keyLen, valueLen;
+				if (end - buf < (long)sizeof(uint32_t))
+					break;
+				memcpy(&keyLen, buf, sizeof(uint32_t));
+				buf += sizeof(uint32_t);
+				if (end - buf < (long)(keyLen + sizeof(uint32_t)))
+					break;
+				string k(buf, keyLen);
+				buf += keyLen;
+				memcpy(&valueLen, buf, sizeof(uint32_t));
+				buf += sizeof(uint32_t);
+				if (end - buf < (long)valueLen)
+					break;
+				pairs.emplace_back(k, string(buf, valueLen));
+				buf += valueLen;
+			}
+			break;
+		}
+		case MERKLE:{
+			const string &body = tuple.at(3);
+			const char *buf = body.data();
+			size_t entry = sizeof(uint32_t) + sizeof(uint64_t);
+			uint32_t count = 0;
+			if (body.size() < 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t))
+				break;
+			memcpy(&rangeStart, buf, sizeof(uint64_t));
+			memcpy(&rangeEnd, buf + sizeof(uint64_t), sizeof(uint64_t));
+			pull = buf[2 * sizeof(uint64_t)] != 0;
+			memcpy(&count, buf + 2 * sizeof(uint64_t) + 1, sizeof(uint32_t));
+			buf += 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t);
+			if (body.size() < 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t) + count * entry)
+				break;
+			for (uint32_t i = 0; i < count; i++) {
+				uint32_t node;
+				uint64_t hash;
+				memcpy(&node, buf, sizeof(uint32_t));
+				memcpy(&hash, buf + sizeof(uint32_t), sizeof(uint64_t));
+				digests.emplace_back(node, hash);
+				buf += entry;
+			}
+			break;
+		}
+		case IMAGE:{
+			const string &body = tuple.at(3);
+			if (body.size() < 4 * sizeof(uint64_t))
+				break;
+			memcpy(&rangeStart, body.data(), sizeof(uint64_t));
+			memcpy(&rangeEnd, body.data() + sizeof(uint64_t), sizeof(uint64_t));
+			memcpy(&imageSize, body.data() + 2 * sizeof(uint64_t), sizeof(uint64_t));
+			memcpy(&chunkOffset, body.data() + 3 * sizeof(uint64_t), sizeof(uint64_t));
+			value = body.substr(4 * sizeof(uint64_t));
+			break;
+		}
 	}
 }
 
@@ -61,6 +158,8 @@ Message::Message(string message){
 // construct a create or update message
 Message::Message(int _transID, Address _fromAddr, MessageType _type, string _key, string _value, ReplicaType _replica){
 	this->delimiter = "::";
+	version = 0;
+	expiresAt = 0;
 	transID = _transID;
 	fromAddr = _fromAddr;
 	type = _type;
@@ -81,6 +180,16 @@ Message::Message(const Message& anotherMessage) {
 	this->transID = anotherMessage.transID;
 	this->type = anotherMessage.type;
 	this->value = anotherMessage.value;
+	this->version = anotherMessage.version;
+	this->expiresAt = anotherMessage.expiresAt;
+	this->rangeStart = anotherMessage.rangeStart;
+	this->rangeEnd = anotherMessage.rangeEnd;
+	this->pairs = anotherMessage.pairs;
+	this->digests = anotherMessage.digests;
+	this->pull = anotherMessage.pull;
+	this->refresh = anotherMessage.refresh;
+	this->imageSize = anotherMessage.imageSize;
+	this->chunkOffset = anotherMessage.chunkOffset;
 }
 
 /**
@@ -88,6 +197,8 @@ Message::Message(const Message& anotherMessage) {
  */
 Message::Message(int _transID, Address _fromAddr, MessageType _type, string _key, string _value){
 	this->delimiter = "::";
+	version = 0;
+	expiresAt = 0;
 	transID = _transID;
 	fromAddr = _fromAddr;
 	type = _type;
@@ -101,6 +212,8 @@ Message::Message(int _transID, Address _fromAddr, MessageType _type, string _key
 // construct a read or delete message
 Message::Message(int _transID, Address _fromAddr, MessageType _type, string _key){
 	this->delimiter = "::";
+	version = 0;
+	expiresAt = 0;
 	transID = _transID;
 	fromAddr = _fromAddr;
 	type = _type;
@@ -113,6 +226,8 @@ Message::Message(int _transID, Address _fromAddr, MessageType _type, string _key
 // construct reply message
 Message::Message(int _transID, Address _fromAddr, MessageType _type, bool _success){
 	this->delimiter = "::";
+	version = 0;
+	expiresAt = 0;
 	transID = _transID;
 	fromAddr = _fromAddr;
 	type = _type;
@@ -125,12 +240,33 @@ Message::Message(int _transID, Address _fromAddr, MessageType _type, bool _succe
 // construct read reply message
 Message::Message(int _transID, Address _fromAddr, string _value){
 	this->delimiter = "::";
+	version = 0;
+	expiresAt = 0;
 	transID = _transID;
 	fromAddr = _fromAddr;
 	type = READREPLY;
 	value = _value;
 }
 
+/**
+ * Constructor
+ */
+// construct an empty transfer, merkle or image message, pairs, digests or the chunk are added by the sender
+Message::Message(int _transID, Address _fromAddr, MessageType _type, uint64_t _rangeStart, uint64_t _rangeEnd){
+	this->delimiter = "::";
+	version = 0;
+	expiresAt = 0;
+	transID = _transID;
+	fromAddr = _fromAddr;
+	type = _type;
+	pull = false;
+	refresh = false;
+	imageSize = 0;
+	chunkOffset = 0;
+	rangeStart = _rangeStart;
+	rangeEnd = _rangeEnd;
+}
+
 /**
  * FUNCTION NAME: toString
  *
@@ -141,25 +277,93 @@ string Message::toString(){
 	switch(type){
 		case CREATE:
 		case UPDATE:
-			message += key + delimiter + value + delimiter + to_string(replica);
+			message += key + delimiter + value + delimiter + to_string(replica) + delimiter + to_string(version) + delimiter + to_string(expiresAt);
 			break;
 		case READ:
-		case DELETE:
 			message += key;
 			break;
+		case DELETE:
+			message += key + delimiter + to_string(version);
+			break;
 		case REPLY:
 			if (success)
 				message += "1";
 			else
 				message += "0";
+			if (!value.empty())
+				message += delimiter + value;
 			break;
 		case READREPLY:
+			message += value + delimiter + to_string(version) + delimiter + to_string(expiresAt);
+			break;
+		case TRANSFER:{
+			size_t header = message.size();
+			uint32_t count = pairs.size();
+			message.resize(transferSize());
+			char *buf = &message[header];
+			memcpy(buf, &rangeStart, sizeof(uint64_t));
+			memcpy(buf + sizeof(uint64_t), &rangeEnd, sizeof(uint64_t));
+			buf[2 * sizeof(uint64_t)] = refresh ? 1 : 0;
+			memcpy(buf + 2 * sizeof(uint64_t) + 1, &count, sizeof(uint32_t));
+			buf += 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t);
+			for (auto &kv : pairs) {
+				uint32_t keyLen = kv.first.size(), valueLen = kv.second.size();
+				memcpy(buf, &keyLen, sizeof(uint32_t));
+				memcpy(buf + sizeof(uint32_t), kv.first.data(), keyLen);
+				buf += sizeof(uint32_t) + keyLen;
+				memcpy(buf, &valueLen, sizeof(uint32_t));
+				memcpy(buf + sizeof(uint32_t), kv.second.data(), valueLen);
+				buf += sizeof(uint32_t) + valueLen;
+			}
+			break;
+		}
+		case MERKLE:{
+			uint32_t count = digests.size();
+			char flag = pull ? 1 : 0;
+			message.append((const char *)&rangeStart, sizeof(uint64_t));
+			message.append((const char *)&rangeEnd, sizeof(uint64_t));
+			message.append(&flag, 1);
+			message.append((const char *)&count, sizeof(uint32_t));
+			for (auto &d : digests) {
+				message.append((const char *)&d.first, sizeof(uint32_t));
+				message.append((const char *)&d.second, sizeof(uint64_t));
+			}
+			break;
+		}
+		case IMAGE:{
+			message.append((const char *)&rangeStart, sizeof(uint64_t));
+			message.append((const char *)&rangeEnd, sizeof(uint64_t));
+			message.append((const char *)&imageSize, sizeof(uint64_t));
+			message.append((const char *)&chunkOffset, sizeof(uint64_t));
 			message += value;
 			break;
+		}
 	}
 	return message;
 }
 
+/**
+ * FUNCTION NAME: pairSize
+ *
+ * DESCRIPTION: Bytes a key value pair takes in the body of a transfer message
+ */
+size_t Message::pairSize(string_view key, string_view value){
+	return 2 * sizeof(uint32_t) + key.size() + value.size();
+}
+
+/**
+ * FUNCTION NAME: transferSize
+ *
+ * DESCRIPTION: Size of the serialized transfer message with its current pairs
+ */
+size_t Message::transferSize(){
+	size_t size = to_string(transID).size() + fromAddr.getAddress().size() + to_string(type).size() + 3 * delimiter.size();
+	size += 2 * sizeof(uint64_t) + 1 + sizeof(uint32_t);
+	for (auto &kv : pairs)
+		size += pairSize(kv.first, kv.second);
+	return size;
+}
+
 /**
  * Assignment operator overloading
  */
@@ -172,5 +376,15 @@ Message& Message::operator =(const Message& anotherMessage) {
 	this->transID = anotherMessage.transID;
 	this->type = anotherMessage.type;
 	this->value = anotherMessage.value;
+	this->version = anotherMessage.version;
+	this->expiresAt = anotherMessage.expiresAt;
+	this->rangeStart = anotherMessage.rangeStart;
+	this->rangeEnd = anotherMessage.rangeEnd;
+	this->pairs = anotherMessage.pairs;
+	this->digests = anotherMessage.digests;
+	this->pull = anotherMessage.pull;
+	this->refresh = anotherMessage.refresh;
+	this->imageSize = anotherMessage.imageSize;
+	this->chunkOffset = anotherMessage.chunkOffset;
 	return *this;
 }
@@ -9,6 +9,8 @@
 #include "stdincludes.h"
 #include "Member.h"
 #include "common.h"
+#include <stdint.h>
+#include <string_view>
 
 /**
  * CLASS NAME: Message
@@ -20,10 +22,29 @@ public:
 	MessageType type;
 	ReplicaType replica;
 	string key;
+	// reply to a garbage collection batch: in value a '1' for every pair the replica holds
+	// at the same or a newer version, a '0' for the others
 	string value;
 	Address fromAddr;
 	int transID;
 	bool success; // success or not 
+	// create, update and read reply: version of the value, see Entry
+	uint64_t version;
+	// create, update and read reply: tick the value expires at, 0 if it never does
+	uint64_t expiresAt;
+	// transfer and merkle: the range (rangeStart, rangeEnd] of the ring the message is about
+	uint64_t rangeStart;
+	uint64_t rangeEnd;
+	// transfer only: key value pairs of the range, and whether they only refresh keys the
+	// receiver holds, as sent by garbage collection
+	vector<pair<string, string>> pairs;
+	bool refresh;
+	// merkle only: (tree node, hash) to compare, or leaves asked for when pull is set
+	vector<pair<uint32_t, uint64_t>> digests;
+	bool pull;
+	// image only: size of the whole image and offset of the chunk in value
+	uint64_t imageSize;
+	uint64_t chunkOffset;
 	// delimiter
 	string delimiter;
 	// construct a message from a string
@@ -38,9 +59,14 @@ public:
 	Message(int _transID, Address _fromAddr, MessageType _type, bool _success);
 	// construct read reply message
 	Message(int _transID, Address _fromAddr, string _value);
+	// construct an empty transfer, merkle or image message
+	Message(int _transID, Address _fromAddr, MessageType _type, uint64_t _rangeStart, uint64_t _rangeEnd);
 	Message& operator = (const Message& anotherMessage);
 	// serialize to a string
 	string toString();
+	// transfer only: bytes a pair adds to the serialized message, and the serialized size
+	static size_t pairSize(string_view key, string_view value);
+	size_t transferSize();
 };
 
 #endif
@@ -9,12 +9,22 @@
 /**
  * constructor
  */
-Node::Node() {}
+Node::Node(): token(0) {}
 
 /**
  * constructor
  */
-Node::Node(Address address) {
+Node::Node(Address address): token(0) {
+	this->nodeAddress = address;
+	computeHashCode();
+}
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: Virtual token of a node, token 0 sits where the node itself hashes to
+ */
+Node::Node(Address address, int token): token(token) {
 	this->nodeAddress = address;
 	computeHashCode();
 }
@@ -27,10 +37,11 @@ Node::~Node() {}
 /**
  * FUNCTION NAME: computeHashCode
  *
- * DESCRIPTION: This function computes the hash code of the node address
+ * DESCRIPTION: This function computes the hash code of the node address. All 6 bytes of the
+ * 				address are hashed, seeded with the token number.
  */
 void Node::computeHashCode() {
-	nodeHashCode = hashFunc(nodeAddress.addr)%RING_SIZE;
+	nodeHashCode = hash64(nodeAddress.addr, sizeof(nodeAddress.addr), token);
 }
 
 /**
@@ -39,6 +50,7 @@ void Node::computeHashCode() {
 Node::Node(const Node& another) {
 	this->nodeAddress = another.nodeAddress;
 	this->nodeHashCode = another.nodeHashCode;
+	this->token = another.token;
 }
 
 /**
@@ -47,6 +59,7 @@ Node::Node(const Node& another) {
 Node& Node::operator=(const Node& another) {
 	this->nodeAddress = another.nodeAddress;
 	this->nodeHashCode = another.nodeHashCode;
+	this->token = another.token;
 	return *this;
 }
 
@@ -54,7 +67,24 @@ Node& Node::operator=(const Node& another) {
  * operator overloading
  */
 bool Node::operator < (const Node& another) const {
-	return this->nodeHashCode < another.nodeHashCode;
+	if ( this->nodeHashCode != another.nodeHashCode ) {
+		return this->nodeHashCode < another.nodeHashCode;
+	}
+	// tokens colliding on a position are ordered the same way on every node
+	int cmp = memcmp(this->nodeAddress.addr, another.nodeAddress.addr, sizeof(this->nodeAddress.addr));
+	if ( cmp != 0 ) {
+		return cmp < 0;
+	}
+	return this->token < another.token;
+}
+
+/**
+ * FUNCTION NAME: samePhysicalNode
+ *
+ * DESCRIPTION: true if both tokens belong to the same node
+ */
+bool Node::samePhysicalNode(const Node& another) const {
+	return memcmp(this->nodeAddress.addr, another.nodeAddress.addr, sizeof(this->nodeAddress.addr)) == 0;
 }
 
 /**
@@ -62,7 +92,7 @@ bool Node::operator < (const Node& another) const {
  *
  * DESCRIPTION: return hash code of the node
  */
-size_t Node::getHashCode() {
+uint64_t Node::getHashCode() {
 	return nodeHashCode;
 }
 
@@ -80,7 +110,7 @@ Address * Node::getAddress() {
  *
  * DESCRIPTION: set the hash code of the node
  */
-void Node::setHashCode(size_t hashCode) {
+void Node::setHashCode(uint64_t hashCode) {
 	this->nodeHashCode = hashCode;
 }
 
@@ -9,21 +9,26 @@
 
 #include "stdincludes.h"
 #include "Member.h"
+#include "Hash.h"
 
 class Node {
 public:
 	Address nodeAddress;
-	size_t nodeHashCode;
-	std::hash<string> hashFunc;
+	// position on the 64 bit ring
+	uint64_t nodeHashCode;
+	// which of the node's virtual tokens on the ring this is
+	int token;
 	Node();
 	Node(Address address);
+	Node(Address address, int token);
 	Node(const Node& another);
 	Node& operator=(const Node& another);
 	bool operator < (const Node& another) const;
+	bool samePhysicalNode(const Node& another) const;
 	void computeHashCode();
-	size_t getHashCode();
+	uint64_t getHashCode();
 	Address * getAddress();
-	void setHashCode(size_t hashCode);
+	void setHashCode(uint64_t hashCode);
 	void setAddress(Address address);
 	virtual ~Node();
 };
@@ -21,11 +21,74 @@ void Params::setparams(char *config_file) {
 	char CRUD[10];
 	FILE *fp = fopen(config_file,"r");
 
+	// optional entries, they keep these values when missing from the file
+	VNODES = 1;
+	REPLICATION_FACTOR = 3;
+	READ_QUORUM = 0;
+	WRITE_QUORUM = 0;
+	REBALANCE_RATE = 16000;
+	PERSIST = 0;
+	SNAPSHOT_PERIOD = 100;
+	STORAGE_ENGINE = 0;
+
 	fscanf(fp,"MAX_NNB: %d", &MAX_NNB);
 	fscanf(fp,"\nSINGLE_FAILURE: %d", &SINGLE_FAILURE);
 	fscanf(fp,"\nDROP_MSG: %d", &DROP_MSG);
 	fscanf(fp,"\nMSG_DROP_PROB: %lf", &MSG_DROP_PROB);
 	fscanf(fp,"\nCRUD_TEST: %s", CRUD);
+	// the optional entries follow in any order. They are read as name and value because
+	// matching each literal in turn would eat the common prefix of READ_QUORUM and
+	// REPLICATION_FACTOR when only one of them is present.
+	char name[64];
+	int value;
+	while ( fscanf(fp, " %63[^:]: %d", name, &value) == 2 ) {
+		if ( 0 == strcmp(name, "VNODES") ) {
+			VNODES = value;
+		}
+		else if ( 0 == strcmp(name, "REPLICATION_FACTOR") ) {
+			REPLICATION_FACTOR = value;
+		}
+		else if ( 0 == strcmp(name, "READ_QUORUM") ) {
+			READ_QUORUM = value;
+		}
+		else if ( 0 == strcmp(name, "WRITE_QUORUM") ) {
+			WRITE_QUORUM = value;
+		}
+		else if ( 0 == strcmp(name, "REBALANCE_RATE") ) {
+			REBALANCE_RATE = value;
+		}
+		else if ( 0 == strcmp(name, "PERSIST") ) {
+			PERSIST = value;
+		}
+		else if ( 0 == strcmp(name, "SNAPSHOT_PERIOD") ) {
+			SNAPSHOT_PERIOD = value;
+		}
+		else if ( 0 == strcmp(name, "STORAGE_ENGINE") ) {
+			STORAGE_ENGINE = value;
+		}
+	}
+	if ( VNODES < 1 ) {
+		VNODES = 1;
+	}
+	if ( REPLICATION_FACTOR < 1 || REPLICATION_FACTOR > MAX_REPLICAS ) {
+		REPLICATION_FACTOR = 3;
+	}
+	// quorums default to a majority of the replicas
+	if ( READ_QUORUM < 1 || READ_QUORUM > REPLICATION_FACTOR ) {
+		READ_QUORUM = REPLICATION_FACTOR / 2 + 1;
+	}
+	if ( WRITE_QUORUM < 1 || WRITE_QUORUM > REPLICATION_FACTOR ) {
+		WRITE_QUORUM = REPLICATION_FACTOR / 2 + 1;
+	}
+	if ( REBALANCE_RATE < 1 ) {
+		REBALANCE_RATE = 16000;
+	}
+	if ( SNAPSHOT_PERIOD < 1 ) {
+		SNAPSHOT_PERIOD = 100;
+	}
+	if ( STORAGE_ENGINE != 1 ) {
+		STORAGE_ENGINE = 0;
+	}
 
 	if ( 0 == strcmp(CRUD, "CREATE") ) {
 		this->CRUDTEST = CREATE_TEST;
@@ -32,6 +32,14 @@ public:
 	int allNodesJoined;
 	short PORTNUM;
 	int CRUDTEST;
+	int VNODES;					// number of tokens each node owns on the ring
+	int REPLICATION_FACTOR;		// number of nodes holding a copy of each key
+	int READ_QUORUM;			// replies needed for a read to succeed
+	int WRITE_QUORUM;			// replies needed for a create, update or delete to succeed
+	int REBALANCE_RATE;			// bytes per tick a node may send to move keys after a ring change
+	int PERSIST;				// 1 to keep a write ahead log and snapshots of every node on disk, 2 to also reload those of the previous run
+	int SNAPSHOT_PERIOD;		// ticks between two chances to compact the log into a snapshot
+	int STORAGE_ENGINE;			// table of every partition, HASH_ENGINE (0) or LSM_ENGINE (1)
 	Params();
 	void setparams(char *);
 	int getcurrtime();
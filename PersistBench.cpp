@@ -0,0 +1,132 @@
+/**********************************
+ * FILE NAME: PersistBench.cpp
+ *
+ * DESCRIPTION: Benchmark of recovering a node's store from its snapshot and write ahead log
+ * 				against refilling it from its peers with TRANSFER messages.
+ * 				Usage: ./PersistBench [max power of ten, default 6]
+ * 				For 10^3 keys up to 10^max keys, 90% of the keys go to a snapshot and the
+ * 				rest to the log, committed in groups of one tick's worth of writes.
+ **********************************/
+
+#include "Persistence.h"
+#include "Message.h"
+#include "Entry.h"
+#include <chrono>
+
+// writes committed together, about what a busy node applies in one tick
+static const size_t WRITES_PER_TICK = 100;
+// TRANSFER batches about the size the rebalance job sends next to the gossip trailer
+static const size_t BATCH_BYTES = 3000;
+// default REBALANCE_RATE, bytes a node sends per tick to move keys
+static const size_t RATE = 16000;
+
+// millisSince() wall time since start
+double millisSince(chrono::steady_clock::time_point start) {
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// testKey() the i-th distinct key of 5 alphanumeric characters, see HashTableBench.cpp
+string testKey(size_t i) {
+	static const char alphanum[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+	string key(5, '0');
+	for ( int c = 4; c >= 0; c-- ) {
+		key[c] = alphanum[i % 62];
+		i /= 62;
+	}
+	return key;
+}
+
+/**
+ * FUNCTION NAME: rereplicate
+ *
+ * DESCRIPTION: Send every key of a store to a fresh one the way peers refill a node: pack
+ * 				them in TRANSFER messages, parse the messages and write their pairs
+ *
+ * RETURNS:
+ * bytes sent
+ */
+size_t rereplicate(RangeStore &from, RangeStore &to) {
+	Address addr;
+	Message batch(0, addr, MessageType::TRANSFER, 0, 0);
+	size_t batchSize = batch.transferSize();
+	size_t bytes = 0;
+	auto send = [&]() {
+		string wire = batch.toString();
+		bytes += wire.size();
+		Message received(wire);
+		to.bulkWrite(received.pairs);
+		batch.pairs.clear();
+		batchSize = batch.transferSize();
+	};
+	for ( size_t p = 0; p < from.size(); p++ ) {
+		from.partition(p).forEach([&](string_view key, string_view value) {
+			size_t size = Message::pairSize(key, value);
+			if ( batchSize + size > BATCH_BYTES && !batch.pairs.empty() ) {
+				send();
+			}
+			batch.pairs.emplace_back(key, value);
+			batchSize += size;
+		});
+	}
+	if ( !batch.pairs.empty() ) {
+		send();
+	}
+	return bytes;
+}
+
+int main(int argc, char *argv[]) {
+	int maxPower = argc > 1 ? atoi(argv[1]) : 6;
+	printf("%9s %10s %10s %10s %10s %12s %12s %10s\n", "keys", "write us", "snap KB", "log KB",
+		"recover ms", "rerepl ms", "rerepl KB", "ticks");
+	size_t n = 100;
+	for ( int power = 3; power <= maxPower; power++ ) {
+		n *= 10;
+		string name = "bench" + to_string(power);
+		RangeStore store;
+		size_t writeMicros = 0;
+		{
+			Persistence persist(name);
+			persist.recover(store);
+			store.onChange = [&](size_t, string_view key, const string_view *, const string_view *newValue) {
+				if ( newValue ) {
+					persist.logPut(key, *newValue);
+				}
+				else {
+					persist.logErase(key);
+				}
+			};
+			auto start = chrono::steady_clock::now();
+			for ( size_t i = 0; i < n; i++ ) {
+				store.upsert(testKey(hash64(&i, sizeof(i)) % (916132832 - n) / n * n + i),
+					Entry("value" + to_string(i), Entry::makeVersion(1, 1)).encode());
+				if ( (i + 1) % WRITES_PER_TICK == 0 ) {
+					persist.commit();
+				}
+				if ( i + 1 == n * 9 / 10 ) {
+					persist.snapshot(store);
+				}
+			}
+			persist.commit();
+			writeMicros = (size_t)(millisSince(start) * 1000 / n);
+			printf("%9zu %10zu %10zu %10zu", n, writeMicros, persist.snapshotSize() / 1024, persist.logSize() / 1024);
+			store.onChange = nullptr;
+		}
+
+		RangeStore recovered;
+		Persistence persist(name);
+		RecoveryStats stats = persist.recover(recovered);
+
+		RangeStore refilled;
+		auto start = chrono::steady_clock::now();
+		size_t bytes = rereplicate(store, refilled);
+		double rereplicateMillis = millisSince(start);
+		if ( recovered.currentSize() != n || refilled.currentSize() != n ) {
+			printf("\nkeys lost: %lu recovered, %lu refilled of %zu\n", recovered.currentSize(), refilled.currentSize(), n);
+		}
+		printf(" %10.2f %12.2f %12zu %10zu\n", stats.millis, rereplicateMillis, bytes / 1024, (bytes + RATE - 1) / RATE);
+		unlink((string(PERSIST_DIR) + "/" + name + ".snap").c_str());
+		unlink((string(PERSIST_DIR) + "/" + name + ".wal").c_str());
+	}
+	printf("ticks: ticks to refill the store through peers at the default REBALANCE_RATE of %zu bytes\n", RATE);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/**********************************
+ * FILE NAME: Persistence.cpp
+ *
+ * DESCRIPTION: Persistence class definition
+ **********************************/
+
+#include "Persistence.h"
+#include <sys/stat.h>
+#include <chrono>
+
+static const char LOG_MAGIC[] = "KVWAL001";
+static const char SNAPSHOT_MAGIC[] = "KVSNAP01";
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: Files of the node called name in PERSIST_DIR. Nothing is read or written
+ * 				until recover is called.
+ */
+Persistence::Persistence(const string &name): logFile(nullptr), generation(0), pendingRecords(0), logBytes(0), snapshotBytes(0) {
+	mkdir(PERSIST_DIR, 0755);
+	logPath = string(PERSIST_DIR) + "/" + name + ".wal";
+	snapshotPath = string(PERSIST_DIR) + "/" + name + ".snap";
+}
+
+Persistence::~Persistence() {
+	commit();
+	if ( logFile ) {
+		fclose(logFile);
+	}
+}
+
+/**
+ * FUNCTION NAME: appendRecord
+ *
+ * DESCRIPTION: Serialize one record at the end of out
+ */
+void Persistence::appendRecord(string &out, RecordType op, string_view key, string_view value) {
+	size_t start = out.size();
+	uint8_t type = (uint8_t)op;
+	uint32_t keyLen = (uint32_t)key.size(), valueLen = (uint32_t)value.size();
+	out.append(sizeof(uint32_t), '\0');
+	out.append((const char *)&type, sizeof(type));
+	out.append((const char *)&keyLen, sizeof(keyLen));
+	out.append((const char *)&valueLen, sizeof(valueLen));
+	out.append(key.data(), key.size());
+	out.append(value.data(), value.size());
+	size_t body = start + sizeof(uint32_t);
+	uint32_t check = (uint32_t)hash64(out.data() + body, out.size() - body);
+	memcpy(&out[start], &check, sizeof(check));
+}
+
+// header() first bytes of a log or snapshot file: the magic and the generation
+string Persistence::header(const char *magic, uint64_t generation) {
+	string out(magic, 8);
+	out.append((const char *)&generation, sizeof(generation));
+	return out;
+}
+
+/**
+ * FUNCTION NAME: logPut
+ *
+ * DESCRIPTION: Buffer the new value of a key until the next commit
+ */
+void Persistence::logPut(string_view key, string_view value) {
+	appendRecord(pending, PUT, key, value);
+	pendingRecords++;
+}
+
+/**
+ * FUNCTION NAME: logErase
+ *
+ * DESCRIPTION: Buffer the deletion of a key until the next commit
+ */
+void Persistence::logErase(string_view key) {
+	appendRecord(pending, ERASE, key, string_view());
+	pendingRecords++;
+}
+
+/**
+ * FUNCTION NAME: commit
+ *
+ * DESCRIPTION: Write the buffered records to the log with one write and make them durable
+ * 				with one fsync
+ *
+ * RETURNS:
+ * bytes written
+ */
+size_t Persistence::commit() {
+	if ( pending.empty() ) {
+		return 0;
+	}
+	if ( logFile == nullptr ) {
+		startLog();
+	}
+	size_t bytes = fwrite(pending.data(), 1, pending.size(), logFile);
+	fflush(logFile);
+	fsync(fileno(logFile));
+	logBytes += bytes;
+	pending.clear();
+	pendingRecords = 0;
+	return bytes;
+}
+
+// startLog() replaces the log with an empty one of the current generation
+void Persistence::startLog() {
+	if ( logFile ) {
+		fclose(logFile);
+	}
+	logFile = fopen(logPath.c_str(), "wb");
+	string head = header(LOG_MAGIC, generation);
+	fwrite(head.data(), 1, head.size(), logFile);
+	fflush(logFile);
+	fsync(fileno(logFile));
+	logBytes = 0;
+}
+
+/**
+ * FUNCTION NAME: snapshot
+ *
+ * DESCRIPTION: Write every key of the store to a new snapshot, which replaces the old one
+ * 				and the log. Buffered records are dropped, the snapshot holds their changes.
+ *
+ * RETURNS:
+ * bytes of the snapshot
+ */
+size_t Persistence::snapshot(RangeStore &store) {
+	string tmpPath = snapshotPath + ".tmp";
+	FILE *fp = fopen(tmpPath.c_str(), "wb");
+	if ( fp == nullptr ) {
+		return 0;
+	}
+	generation++;
+	string out = header(SNAPSHOT_MAGIC, generation);
+	size_t bytes = 0;
+	for ( size_t p = 0; p < store.size(); p++ ) {
+		store.partition(p).forEach([&](string_view key, string_view value) {
+			appendRecord(out, PUT, key, value);
+			// written in chunks, a snapshot is not held in memory whole
+			if ( out.size() >= (1 << 20) ) {
+				bytes += fwrite(out.data(), 1, out.size(), fp);
+				out.clear();
+			}
+		});
+	}
+	bytes += fwrite(out.data(), 1, out.size(), fp);
+	fflush(fp);
+	fsync(fileno(fp));
+	fclose(fp);
+	rename(tmpPath.c_str(), snapshotPath.c_str());
+	snapshotBytes = bytes;
+	pending.clear();
+	pendingRecords = 0;
+	startLog();
+	return bytes;
+}
+
+/**
+ * FUNCTION NAME: readFile
+ *
+ * DESCRIPTION: Read a whole log or snapshot file and check its magic
+ *
+ * RETURNS:
+ * true with the records in data and the generation of the file, false if missing or invalid
+ */
+bool Persistence::readFile(const string &path, const char *magic, string &data, uint64_t &fileGeneration) {
+	FILE *fp = fopen(path.c_str(), "rb");
+	if ( fp == nullptr ) {
+		return false;
+	}
+	data.clear();
+	char buffer[1 << 16];
+	size_t n;
+	while ( (n = fread(buffer, 1, sizeof(buffer), fp)) > 0 ) {
+		data.append(buffer, n);
+	}
+	fclose(fp);
+	if ( data.size() < HEADER_SIZE || memcmp(data.data(), magic, 8) != 0 ) {
+		return false;
+	}
+	memcpy(&fileGeneration, data.data() + 8, sizeof(fileGeneration));
+	return true;
+}
+
+/**
+ * FUNCTION NAME: replay
+ *
+ * DESCRIPTION: Apply the records after the header of a file to the store, last write wins
+ *
+ * RETURNS:
+ * number of records applied
+ */
+unsigned long Persistence::replay(const string &data, RangeStore &store) {
+	unsigned long records = 0;
+	size_t at = HEADER_SIZE;
+	while ( at + RECORD_HEADER <= data.size() ) {
+		uint32_t check, keyLen, valueLen;
+		uint8_t type;
+		memcpy(&check, &data[at], sizeof(check));
+		memcpy(&type, &data[at + 4], sizeof(type));
+		memcpy(&keyLen, &data[at + 5], sizeof(keyLen));
+		memcpy(&valueLen, &data[at + 9], sizeof(valueLen));
+		size_t end = at + RECORD_HEADER + (size_t)keyLen + valueLen;
+		if ( end > data.size() || check != (uint32_t)hash64(&data[at + 4], end - at - 4) ) {
+			break;
+		}
+		string_view key(&data[at + RECORD_HEADER], keyLen);
+		if ( type == PUT ) {
+			store.upsert(key, string_view(&data[at + RECORD_HEADER + keyLen], valueLen));
+		}
+		else if ( type == ERASE ) {
+			store.eraseIfPresent(key);
+		}
+		records++;
+		at = end;
+	}
+	return records;
+}
+
+/**
+ * FUNCTION NAME: recover
+ *
+ * DESCRIPTION: Load the snapshot and replay the log written after it into the store, then
+ * 				compact both into a new snapshot
+ */
+RecoveryStats Persistence::recover(RangeStore &store) {
+	RecoveryStats stats = {0, 0, 0, 0};
+	auto start = chrono::steady_clock::now();
+	string data;
+	uint64_t fileGeneration = 0;
+	generation = 0;
+	if ( readFile(snapshotPath, SNAPSHOT_MAGIC, data, fileGeneration) ) {
+		generation = fileGeneration;
+		stats.snapshotKeys = replay(data, store);
+		stats.bytesRead += data.size();
+	}
+	if ( readFile(logPath, LOG_MAGIC, data, fileGeneration) && fileGeneration >= generation ) {
+		stats.logRecords = replay(data, store);
+		stats.bytesRead += data.size();
+	}
+	stats.millis = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	snapshot(store);
+	return stats;
+}
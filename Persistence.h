@@ -0,0 +1,87 @@
+/**********************************
+ * FILE NAME: Persistence.h
+ *
+ * DESCRIPTION: Header file Persistence class
+ **********************************/
+
+#ifndef PERSISTENCE_H_
+#define PERSISTENCE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "RangeStore.h"
+
+/**
+ * Macros
+ */
+// directory holding the log and snapshot of every node
+#define PERSIST_DIR "persist"
+// values of PERSIST in Params.h: start from empty files, or reload those left by a previous run
+#define PERSIST_FRESH 1
+#define PERSIST_RECOVER 2
+
+/**
+ * STRUCT NAME: RecoveryStats
+ *
+ * DESCRIPTION: What a recovery read back from disk
+ */
+struct RecoveryStats {
+	unsigned long snapshotKeys;
+	unsigned long logRecords;
+	size_t bytesRead;
+	double millis;
+};
+
+/**
+ * CLASS NAME: Persistence
+ *
+ * DESCRIPTION: On disk copy of the store of a node: an append only write ahead log of the
+ * 				changes and a snapshot of the whole store that the log starts from.
+ * 				Changes are buffered and written with a single write and fsync per call to
+ * 				commit, once per tick (group commit). A snapshot is written to a temporary
+ * 				file and renamed over the last one, then the log starts over empty.
+ * 				Both files start with a generation number: a log older than the snapshot
+ * 				is left over from a crash between the two steps and is not replayed.
+ * 				Every record is [u32 check][u8 op][u32 key length][u32 value length][key]
+ * 				[value], check being the low bits of hash64 of the rest. Replay stops at the
+ * 				first torn or corrupt record.
+ */
+class Persistence {
+	enum RecordType { PUT = 1, ERASE = 2 };
+	static const size_t HEADER_SIZE = 16;
+	static const size_t RECORD_HEADER = 13;
+
+	string logPath;
+	string snapshotPath;
+	FILE *logFile;
+	uint64_t generation;
+	// records buffered since the last commit
+	string pending;
+	unsigned long pendingRecords;
+	// record bytes in the log, after its header
+	size_t logBytes;
+	size_t snapshotBytes;
+
+	static void appendRecord(string &out, RecordType op, string_view key, string_view value);
+	static string header(const char *magic, uint64_t generation);
+	bool readFile(const string &path, const char *magic, string &data, uint64_t &fileGeneration);
+	unsigned long replay(const string &data, RangeStore &store);
+	void startLog();
+public:
+	Persistence(const string &name);
+	Persistence(const Persistence &other) = delete;
+	Persistence &operator=(const Persistence &other) = delete;
+	void logPut(string_view key, string_view value);
+	void logErase(string_view key);
+	bool hasPending() const { return pendingRecords > 0; }
+	size_t commit();
+	size_t snapshot(RangeStore &store);
+	RecoveryStats recover(RangeStore &store);
+	size_t logSize() const { return logBytes; }
+	size_t snapshotSize() const { return snapshotBytes; }
+	virtual ~Persistence();
+};
+
+#endif /* PERSISTENCE_H_ */
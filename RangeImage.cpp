@@ -0,0 +1,234 @@
+/**********************************
+ * FILE NAME: RangeImage.cpp
+ *
+ * DESCRIPTION: RangeImage class definition
+ **********************************/
+
+#include "RangeImage.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char IMAGE_MAGIC[] = "KVIMG001";
+
+/**
+ * FUNCTION NAME: create
+ *
+ * DESCRIPTION: Create an empty file at path in IMAGE_DIR for an image to be written to
+ *
+ * RETURNS:
+ * the file descriptor, -1 on failure
+ */
+int RangeImage::create(const string &path) {
+	mkdir(IMAGE_DIR, 0755);
+	return ::open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+}
+
+/**
+ * FUNCTION NAME: write
+ *
+ * DESCRIPTION: Write the keys of table, which all lie in range, to a new image at path. The
+ * 				records are streamed to the file in scan order through a TableCursor, only
+ * 				their offsets are kept in memory, and are then sorted by the keys read back
+ * 				from the mapped file, so a partition larger than memory can be written.
+ *
+ * RETURNS:
+ * bytes of the image, 0 if it could not be written
+ */
+size_t RangeImage::write(const string &path, const RingRange &range, StorageEngine &table) {
+	int out = create(path);
+	if ( out < 0 ) {
+		return 0;
+	}
+	uint64_t records = 0, check = 0;
+	string head(IMAGE_MAGIC, 8);
+	head.append((const char *)&range.start, sizeof(uint64_t));
+	head.append((const char *)&range.end, sizeof(uint64_t));
+	head.append((const char *)&records, sizeof(uint64_t));
+	head.append((const char *)&check, sizeof(uint64_t));
+	bool written = ::write(out, head.data(), head.size()) == (ssize_t)head.size();
+	vector<uint64_t> offsets;
+	offsets.reserve(table.currentSize());
+	string buffer;
+	uint64_t offset = HEADER_SIZE;
+	TableCursor cursor;
+	string_view key, value;
+	while ( written && table.next(cursor, key, value) ) {
+		offsets.push_back(offset);
+		uint32_t keyLen = (uint32_t)key.size(), valueLen = (uint32_t)value.size();
+		buffer.append((const char *)&keyLen, sizeof(keyLen));
+		buffer.append((const char *)&valueLen, sizeof(valueLen));
+		buffer.append(key.data(), key.size());
+		buffer.append(value.data(), value.size());
+		offset += RECORD_HEADER + keyLen + valueLen;
+		if ( buffer.size() >= IMAGE_WRITE_BUFFER ) {
+			written = ::write(out, buffer.data(), buffer.size()) == (ssize_t)buffer.size();
+			buffer.clear();
+		}
+	}
+	if ( written && !buffer.empty() ) {
+		written = ::write(out, buffer.data(), buffer.size()) == (ssize_t)buffer.size();
+	}
+	string().swap(buffer);
+	// sort the offsets by the keys of the records, read back from the file
+	if ( written && !offsets.empty() ) {
+		written = mapFile(path, offset, [&](const char *data) {
+			auto keyOf = [data](uint64_t at) {
+				uint32_t keyLen;
+				memcpy(&keyLen, data + at, sizeof(keyLen));
+				return string_view(data + at + RECORD_HEADER, keyLen);
+			};
+			sort(offsets.begin(), offsets.end(), [&](uint64_t a, uint64_t b) { return keyOf(a) < keyOf(b); });
+		});
+	}
+	size_t offsetBytes = offsets.size() * sizeof(uint64_t);
+	written = written && ::write(out, offsets.data(), offsetBytes) == (ssize_t)offsetBytes;
+	records = offsets.size();
+	size_t length = offset + offsetBytes;
+	vector<uint64_t>().swap(offsets);
+	// the check covers the records and the offsets, hashed over the mapped file
+	written = written && mapFile(path, length, [&](const char *data) {
+		check = hash64(data + HEADER_SIZE, length - HEADER_SIZE);
+	});
+	written = written && pwrite(out, &records, sizeof(records), 24) == (ssize_t)sizeof(records) &&
+		pwrite(out, &check, sizeof(check), 32) == (ssize_t)sizeof(check);
+	close(out);
+	if ( !written ) {
+		unlink(path.c_str());
+		return 0;
+	}
+	return length;
+}
+
+// mapFile() maps the first length bytes of the file at path for reading and calls use on them
+bool RangeImage::mapFile(const string &path, size_t length, const function<void(const char *)> &use) {
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if ( fd < 0 ) {
+		return false;
+	}
+	void *mapped = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if ( mapped == MAP_FAILED ) {
+		return false;
+	}
+	use((const char *)mapped);
+	munmap(mapped, length);
+	return true;
+}
+
+/**
+ * constructor
+ */
+RangeImage::RangeImage(): fd(-1), data(nullptr), length(0), imageRange({0, 0}), count(0) {}
+
+RangeImage::~RangeImage() {
+	if ( data ) {
+		munmap((void *)data, length);
+	}
+	if ( fd >= 0 ) {
+		close(fd);
+	}
+	if ( !path.empty() ) {
+		unlink(path.c_str());
+	}
+}
+
+/**
+ * FUNCTION NAME: open
+ *
+ * DESCRIPTION: Map the image at path and check it whole. The image owns the file from
+ * 				then on, even when it is invalid.
+ *
+ * RETURNS:
+ * false if the file is missing, torn or corrupt
+ */
+bool RangeImage::open(const string &path) {
+	this->path = path;
+	fd = ::open(path.c_str(), O_RDONLY);
+	struct stat info;
+	if ( fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < HEADER_SIZE ) {
+		return false;
+	}
+	void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if ( mapped == MAP_FAILED ) {
+		return false;
+	}
+	data = (const char *)mapped;
+	length = info.st_size;
+	uint64_t check;
+	memcpy(&imageRange.start, data + 8, sizeof(uint64_t));
+	memcpy(&imageRange.end, data + 16, sizeof(uint64_t));
+	memcpy(&count, data + 24, sizeof(uint64_t));
+	memcpy(&check, data + 32, sizeof(uint64_t));
+	if ( memcmp(data, IMAGE_MAGIC, 8) != 0 || count > (length - HEADER_SIZE) / sizeof(uint64_t) ||
+			hash64(data + HEADER_SIZE, length - HEADER_SIZE) != check ) {
+		count = 0;
+		return false;
+	}
+	// the check covers the offsets too, but a record must not reach into them
+	size_t recordsEnd = length - count * sizeof(uint64_t);
+	for ( size_t i = 0; i < count; i++ ) {
+		uint64_t offset;
+		uint32_t keyLen, valueLen;
+		memcpy(&offset, data + recordsEnd + i * sizeof(uint64_t), sizeof(offset));
+		if ( offset < HEADER_SIZE || offset + RECORD_HEADER > recordsEnd ) {
+			count = 0;
+			return false;
+		}
+		memcpy(&keyLen, data + offset, sizeof(keyLen));
+		memcpy(&valueLen, data + offset + 4, sizeof(valueLen));
+		if ( offset + RECORD_HEADER + keyLen + valueLen > recordsEnd ) {
+			count = 0;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: record
+ *
+ * DESCRIPTION: Key and value of the i-th record in key order, views into the mapped file
+ */
+void RangeImage::record(size_t i, string_view &key, string_view &value) const {
+	uint64_t offset;
+	uint32_t keyLen, valueLen;
+	memcpy(&offset, data + length - (count - i) * sizeof(uint64_t), sizeof(offset));
+	memcpy(&keyLen, data + offset, sizeof(keyLen));
+	memcpy(&valueLen, data + offset + 4, sizeof(valueLen));
+	key = string_view(data + offset + RECORD_HEADER, keyLen);
+	value = string_view(data + offset + RECORD_HEADER + keyLen, valueLen);
+}
+
+// keyAt() key of the i-th record
+string_view RangeImage::keyAt(size_t i) const {
+	string_view key, value;
+	record(i, key, value);
+	return key;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: Binary search for key in the mapped records
+ *
+ * RETURNS:
+ * true with value set to a view into the file, false if the image does not hold key
+ */
+bool RangeImage::find(string_view key, string_view &value) const {
+	size_t low = 0, high = count;
+	while ( low < high ) {
+		size_t mid = low + (high - low) / 2;
+		if ( keyAt(mid) < key ) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+	if ( low == count ) {
+		return false;
+	}
+	string_view found;
+	record(low, found, value);
+	return found == key;
+}
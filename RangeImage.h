@@ -0,0 +1,69 @@
+/**********************************
+ * FILE NAME: RangeImage.h
+ *
+ * DESCRIPTION: Header file RangeImage class
+ **********************************/
+
+#ifndef RANGEIMAGE_H_
+#define RANGEIMAGE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "StorageEngine.h"
+#include "RingDiff.h"
+#include "Hash.h"
+
+/**
+ * Macros
+ */
+// directory holding the images being sent or received by every node
+#define IMAGE_DIR "images"
+// bytes of records buffered before they are written out while an image is written
+#define IMAGE_WRITE_BUFFER (64 * 1024)
+
+/**
+ * CLASS NAME: RangeImage
+ *
+ * DESCRIPTION: Read only file of the keys of one range of the ring, used to hand a whole
+ * 				partition to a new replica. The file is
+ * 				[magic][u64 range start][u64 range end][u64 count][u64 check]
+ * 				then the records sorted by key, each [u32 key length][u32 value length][key]
+ * 				[value], then the u64 offset of every record. check is hash64 of all that
+ * 				follows the header. An opened image is mapped in memory and looked up in
+ * 				place by binary search over the offsets, nothing is parsed or copied, so it
+ * 				serves reads as soon as its last byte arrived. The file is removed with the
+ * 				image.
+ */
+class RangeImage {
+	static const size_t HEADER_SIZE = 40;
+	static const size_t RECORD_HEADER = 8;
+
+	string path;
+	int fd;
+	const char *data;
+	size_t length;
+	RingRange imageRange;
+	uint64_t count;
+
+	string_view keyAt(size_t i) const;
+	static bool mapFile(const string &path, size_t length, const function<void(const char *)> &use);
+
+public:
+	static int create(const string &path);
+	static size_t write(const string &path, const RingRange &range, StorageEngine &table);
+
+	RangeImage();
+	RangeImage(const RangeImage &other) = delete;
+	RangeImage &operator=(const RangeImage &other) = delete;
+	bool open(const string &path);
+	bool find(string_view key, string_view &value) const;
+	void record(size_t i, string_view &key, string_view &value) const;
+	unsigned long size() const { return count; }
+	const RingRange &range() const { return imageRange; }
+	string_view contents() const { return string_view(data, length); }
+	virtual ~RangeImage();
+};
+
+#endif /* RANGEIMAGE_H_ */
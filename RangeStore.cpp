@@ -0,0 +1,265 @@
+/**********************************
+ * FILE NAME: RangeStore.cpp
+ *
+ * DESCRIPTION: RangeStore class definition
+ **********************************/
+
+#include "RangeStore.h"
+#include "HashTable.h"
+#include "LsmTable.h"
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: A single partition covering the whole ring until the ring is known
+ */
+RangeStore::RangeStore(int engine, const string &name): engine(engine), name(name), tablesCreated(0) {
+	repartition(vector<uint64_t>());
+}
+
+// newTable() an empty table of the engine of the store
+StorageEngine *RangeStore::newTable() {
+	if ( engine == LSM_ENGINE ) {
+		return new LsmTable(name + "-" + to_string(tablesCreated++));
+	}
+	return new HashTable();
+}
+
+RangeStore::~RangeStore() {
+	for ( auto &part : parts ) {
+		delete part.table;
+	}
+}
+
+/**
+ * FUNCTION NAME: repartition
+ *
+ * DESCRIPTION: Split the store at the given sorted token positions, one partition per token.
+ * 				A partition whose range falls inside one new range is handed over whole,
+ * 				the keys of the others are moved one by one to the partition leading them.
+ * 				No onChange is called for the moves, the set of keys is unchanged.
+ */
+void RangeStore::repartition(const vector<uint64_t> &tokens) {
+	vector<Partition> old;
+	old.swap(parts);
+	ends = tokens;
+	if ( ends.empty() ) {
+		ends.push_back(0);
+	}
+	for ( size_t i = 0; i < ends.size(); i++ ) {
+		RingRange range = {ends[i == 0 ? ends.size() - 1 : i - 1], ends[i]};
+		parts.push_back({range, nullptr, BloomFilter(), 0, 0, 0, true});
+	}
+	for ( auto &part : old ) {
+		part.table->onChange = nullptr;
+		size_t i = route(part.range.end);
+		// a partition handed over whole keeps its filter, one that receives moved keys is
+		// rebuilt when next used
+		if ( parts[i].table == nullptr && parts[i].range.covers(part.range) ) {
+			RingRange range = parts[i].range;
+			parts[i] = move(part);
+			parts[i].range = range;
+			continue;
+		}
+		part.table->forEach([this](string_view key, string_view value) {
+			Partition &to = parts[route(position(key))];
+			if ( to.table == nullptr ) {
+				to.table = newTable();
+			}
+			to.table->upsert(key, value);
+			to.rebuild = true;
+		});
+		delete part.table;
+	}
+	for ( auto &part : parts ) {
+		if ( part.table == nullptr ) {
+			part.table = newTable();
+		}
+	}
+	bindHooks();
+}
+
+// bindHooks() forwards the changes of every partition to onChange with the partition index,
+// and keeps the partition's filter up to date
+void RangeStore::bindHooks() {
+	for ( size_t i = 0; i < parts.size(); i++ ) {
+		parts[i].table->onChange = [this, i](string_view key, const string_view *oldValue, const string_view *newValue) {
+			Partition &part = parts[i];
+			// the table is in the middle of the change, an outgrown filter is rebuilt later
+			if ( newValue && !oldValue ) {
+				part.filter.add(key);
+				part.added++;
+				part.rebuild = part.rebuild || part.added > part.filterKeys;
+			}
+			else if ( !newValue ) {
+				part.erased++;
+				part.rebuild = part.rebuild || part.erased > part.filterKeys / 2;
+			}
+			if ( onChange ) {
+				onChange(i, key, oldValue, newValue);
+			}
+		};
+	}
+}
+
+/**
+ * FUNCTION NAME: rebuildFilter
+ *
+ * DESCRIPTION: Build the filter of a partition anew from its keys, sized for twice as many
+ */
+void RangeStore::rebuildFilter(Partition &part) {
+	part.filterKeys = max((size_t)FILTER_MIN_KEYS, 2 * (size_t)part.table->currentSize());
+	part.filter = BloomFilter(part.filterKeys);
+	part.table->forEach([&part](string_view key, string_view value) {
+		part.filter.add(key);
+	});
+	part.added = part.table->currentSize();
+	part.erased = 0;
+	part.rebuild = false;
+}
+
+// probe() the partition of a key, its filter rebuilt first if due
+RangeStore::Partition &RangeStore::probe(string_view key) {
+	Partition &part = parts[route(position(key))];
+	if ( part.rebuild ) {
+		rebuildFilter(part);
+	}
+	return part;
+}
+
+/**
+ * FUNCTION NAME: route
+ *
+ * DESCRIPTION: Index of the partition holding a position: the first one whose range ends at
+ * 				or after pos, wrapping around to the first one
+ */
+size_t RangeStore::route(uint64_t pos) const {
+	size_t i = lower_bound(ends.begin(), ends.end(), pos) - ends.begin();
+	return i == ends.size() ? 0 : i;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: See StorageEngine::find, in the partition of the key unless its filter rules
+ * 				the key out
+ */
+bool RangeStore::find(string_view key, string_view &value) {
+	Partition &part = probe(key);
+	return part.filter.mayContain(key) && part.table->find(key, value);
+}
+
+/**
+ * FUNCTION NAME: upsert
+ *
+ * DESCRIPTION: See StorageEngine::upsert, in the partition of the key
+ */
+bool RangeStore::upsert(string_view key, string_view value) {
+	return tableOf(key).upsert(key, value);
+}
+
+/**
+ * FUNCTION NAME: updateIfPresent
+ *
+ * DESCRIPTION: See StorageEngine::updateIfPresent, in the partition of the key
+ */
+bool RangeStore::updateIfPresent(string_view key, string_view value, const function<bool(string_view current)> &accept) {
+	Partition &part = probe(key);
+	return part.filter.mayContain(key) && part.table->updateIfPresent(key, value, accept);
+}
+
+/**
+ * FUNCTION NAME: eraseIfPresent
+ *
+ * DESCRIPTION: See StorageEngine::eraseIfPresent, in the partition of the key
+ */
+bool RangeStore::eraseIfPresent(string_view key) {
+	Partition &part = probe(key);
+	return part.filter.mayContain(key) && part.table->eraseIfPresent(key);
+}
+
+/**
+ * FUNCTION NAME: bulkWrite
+ *
+ * DESCRIPTION: Write a batch of (key,value) pairs, last write wins as in StorageEngine::upsert
+ *
+ * RETURNS:
+ * number of pairs stored
+ */
+unsigned long RangeStore::bulkWrite(const vector<pair<string, string>> &pairs) {
+	unsigned long stored = 0;
+	for ( auto &kv : pairs ) {
+		if ( upsert(kv.first, kv.second) ) {
+			stored++;
+		}
+	}
+	return stored;
+}
+
+/**
+ * FUNCTION NAME: isEmpty
+ *
+ * DESCRIPTION: Returns if no partition holds a key
+ */
+bool RangeStore::isEmpty() {
+	for ( auto &part : parts ) {
+		if ( !part.table->isEmpty() ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: currentSize
+ *
+ * DESCRIPTION: Returns the number of keys over all partitions
+ */
+unsigned long RangeStore::currentSize() {
+	unsigned long keys = 0;
+	for ( auto &part : parts ) {
+		keys += part.table->currentSize();
+	}
+	return keys;
+}
+
+/**
+ * FUNCTION NAME: memoryUsed
+ *
+ * DESCRIPTION: Returns the bytes held by the partitions
+ */
+size_t RangeStore::memoryUsed() const {
+	size_t bytes = parts.capacity() * (sizeof(Partition) + sizeof(uint64_t));
+	for ( auto &part : parts ) {
+		bytes += part.table->memoryUsed();
+	}
+	return bytes + filterBytes();
+}
+
+/**
+ * FUNCTION NAME: filterBytes
+ *
+ * DESCRIPTION: Returns the bytes held by the filters of the partitions
+ */
+size_t RangeStore::filterBytes() const {
+	size_t bytes = 0;
+	for ( auto &part : parts ) {
+		bytes += part.filter.memoryUsed();
+	}
+	return bytes;
+}
+
+/**
+ * FUNCTION NAME: tick
+ *
+ * DESCRIPTION: Give every partition its slice of background work and rebuild the filters
+ * 				that are due
+ */
+void RangeStore::tick() {
+	for ( auto &part : parts ) {
+		if ( part.rebuild ) {
+			rebuildFilter(part);
+		}
+		part.table->tick();
+	}
+}
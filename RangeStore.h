@@ -0,0 +1,90 @@
+/**********************************
+ * FILE NAME: RangeStore.h
+ *
+ * DESCRIPTION: Header file RangeStore class
+ **********************************/
+
+#ifndef RANGESTORE_H_
+#define RANGESTORE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "StorageEngine.h"
+#include "RingDiff.h"
+#include "Hash.h"
+#include "BloomFilter.h"
+
+/**
+ * Macros
+ */
+// keys a partition filter is sized for at least
+#define FILTER_MIN_KEYS 64
+
+/**
+ * CLASS NAME: RangeStore
+ *
+ * DESCRIPTION: The local key value store of a node, split in one table per range of the
+ * 				ring: partition i holds the keys of (end of partition i-1, end of partition i].
+ * 				Once aligned with the ring tokens by repartition, the partition of a key is
+ * 				the token leading it, so moving, comparing or dropping a range of the ring
+ * 				works on whole partitions instead of filtering every key of the node.
+ * 				The tables are HashTables or LsmTables, see STORAGE_ENGINE in Params.h.
+ * 				Every partition has a bloom filter of its keys, tested before the table is
+ * 				probed for a key that may be missing. Keys are added to the filter as they are
+ * 				written; the filter is rebuilt from the table once it holds more keys than it
+ * 				was sized for, or once enough keys were erased to leave it mostly stale.
+ */
+class RangeStore {
+	struct Partition {
+		RingRange range;
+		StorageEngine *table;
+		BloomFilter filter;
+		// keys the filter was sized for, keys added and keys erased since it was built
+		size_t filterKeys;
+		size_t added;
+		size_t erased;
+		bool rebuild;
+	};
+	// sorted by range end, the first one wraps around
+	vector<Partition> parts;
+	vector<uint64_t> ends;
+	int engine;
+	// name of the node, tables on disk are named after it
+	string name;
+	unsigned long tablesCreated;
+
+	StorageEngine *newTable();
+	void bindHooks();
+	void rebuildFilter(Partition &part);
+	Partition &probe(string_view key);
+	StorageEngine &tableOf(string_view key) { return *parts[route(position(key))].table; }
+public:
+	// called after every change of a partition, see StorageEngine::onChange
+	function<void(size_t partition, string_view key, const string_view *oldValue, const string_view *newValue)> onChange;
+
+	RangeStore(int engine = HASH_ENGINE, const string &name = "node");
+	RangeStore(const RangeStore &other) = delete;
+	RangeStore &operator=(const RangeStore &other) = delete;
+	static uint64_t position(string_view key) { return hash64(key.data(), key.size()); }
+	void repartition(const vector<uint64_t> &tokens);
+	size_t size() const { return parts.size(); }
+	size_t route(uint64_t pos) const;
+	const RingRange &range(size_t partition) const { return parts[partition].range; }
+	StorageEngine &partition(size_t partition) { return *parts[partition].table; }
+
+	bool find(string_view key, string_view &value);
+	bool upsert(string_view key, string_view value);
+	bool updateIfPresent(string_view key, string_view value, const function<bool(string_view current)> &accept = nullptr);
+	bool eraseIfPresent(string_view key);
+	unsigned long bulkWrite(const vector<pair<string, string>> &pairs);
+	bool isEmpty();
+	unsigned long currentSize();
+	size_t memoryUsed() const;
+	size_t filterBytes() const;
+	void tick();
+	virtual ~RangeStore();
+};
+
+#endif /* RANGESTORE_H_ */
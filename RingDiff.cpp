@@ -0,0 +1,142 @@
+/**********************************
+ * FILE NAME: RingDiff.cpp
+ *
+ * DESCRIPTION: RingSnapshot and RingDiff class definitions
+ **********************************/
+
+#include "RingDiff.h"
+
+/**
+ * FUNCTION NAME: empty
+ *
+ * DESCRIPTION: true if the ring had no replica table, e.g. too few nodes
+ */
+bool RingSnapshot::empty() const {
+	return pos.empty();
+}
+
+/**
+ * FUNCTION NAME: replicasAt
+ *
+ * DESCRIPTION: Replicas of a position: those of the first token >= p, wrapping around
+ */
+const vector<Address>& RingSnapshot::replicasAt(uint64_t p) const {
+	static vector<Address> none;
+	if ( pos.empty() ) {
+		return none;
+	}
+	size_t i = lower_bound(pos.begin(), pos.end(), p) - pos.begin();
+	return replicas[i == pos.size() ? 0 : i];
+}
+
+/**
+ * FUNCTION NAME: hasNode
+ *
+ * DESCRIPTION: true if the node owns tokens in this ring
+ */
+bool RingSnapshot::hasNode(const Address &addr) const {
+	for ( auto &node : nodes ) {
+		if ( RingDiff::sameAddress(node, addr) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * FUNCTION NAME: sameAddress
+ */
+bool RingDiff::sameAddress(const Address &a, const Address &b) {
+	return memcmp(a.addr, b.addr, sizeof(a.addr)) == 0;
+}
+
+/**
+ * FUNCTION NAME: sameReplicas
+ *
+ * DESCRIPTION: true if both sets hold the same nodes, in any order. A new primary among the
+ * 				same nodes does not move any data.
+ */
+bool RingDiff::sameReplicas(const vector<Address> &a, const vector<Address> &b) {
+	if ( a.size() != b.size() ) {
+		return false;
+	}
+	for ( auto &x : a ) {
+		bool found = false;
+		for ( auto &y : b ) {
+			if ( sameAddress(x, y) ) {
+				found = true;
+				break;
+			}
+		}
+		if ( !found ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * FUNCTION NAME: diff
+ *
+ * DESCRIPTION: Cut the ring at the tokens of both rings. Inside each resulting range both
+ * 				rings have a single replica set, so comparing them at the range end tells
+ * 				whether the range moved. Adjacent moved ranges with the same old and new
+ * 				replicas are merged.
+ *
+ * RETURNS:
+ * moved ranges ordered by range end, the range wrapping around the max position first
+ */
+vector<RingTransfer> RingDiff::diff(const RingSnapshot &oldRing, const RingSnapshot &newRing) {
+	vector<RingTransfer> transfers;
+	vector<uint64_t> cuts;
+	cuts.reserve(oldRing.pos.size() + newRing.pos.size());
+	merge(oldRing.pos.begin(), oldRing.pos.end(), newRing.pos.begin(), newRing.pos.end(), back_inserter(cuts));
+	cuts.erase(unique(cuts.begin(), cuts.end()), cuts.end());
+
+	for ( size_t k = 0; k < cuts.size(); k++ ) {
+		RingRange range;
+		range.start = cuts[k == 0 ? cuts.size() - 1 : k - 1];
+		range.end = cuts[k];
+		const vector<Address> &before = oldRing.replicasAt(range.end);
+		const vector<Address> &after = newRing.replicasAt(range.end);
+		if ( sameReplicas(before, after) ) {
+			continue;
+		}
+		if ( k > 0 && !transfers.empty() && transfers.back().range.end == range.start
+				&& sameReplicas(transfers.back().oldReplicas, before)
+				&& sameReplicas(transfers.back().newReplicas, after) ) {
+			transfers.back().range.end = range.end;
+			continue;
+		}
+		RingTransfer transfer;
+		transfer.range = range;
+		transfer.oldReplicas = before;
+		transfer.newReplicas = after;
+		transfers.push_back(transfer);
+	}
+	return transfers;
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: The transfer whose range holds pos in the output of diff
+ *
+ * RETURNS:
+ * pointer to the transfer, nullptr if pos did not move
+ */
+const RingTransfer* RingDiff::find(const vector<RingTransfer> &transfers, uint64_t pos) {
+	if ( transfers.empty() ) {
+		return nullptr;
+	}
+	auto it = lower_bound(transfers.begin(), transfers.end(), pos,
+		[](const RingTransfer &t, uint64_t p) { return t.range.end < p; });
+	if ( it != transfers.end() && it->range.contains(pos) ) {
+		return &(*it);
+	}
+	// past the last end, only the range wrapping around can hold it
+	if ( transfers.front().range.contains(pos) ) {
+		return &transfers.front();
+	}
+	return nullptr;
+}
@@ -0,0 +1,89 @@
+/**********************************
+ * FILE NAME: RingDiff.h
+ *
+ * DESCRIPTION: Header file of RingSnapshot and RingDiff classes
+ **********************************/
+
+#ifndef RINGDIFF_H_
+#define RINGDIFF_H_
+
+#include "stdincludes.h"
+#include "Member.h"
+#include <stdint.h>
+
+/**
+ * STRUCT NAME: RingRange
+ *
+ * DESCRIPTION: Positions (start, end] of the ring. The range wraps around past the max
+ * 				position when start >= end, and covers the whole ring when start == end.
+ */
+struct RingRange {
+	uint64_t start;
+	uint64_t end;
+	bool contains(uint64_t pos) const {
+		if ( start < end ) {
+			return pos > start && pos <= end;
+		}
+		return pos > start || pos <= end;
+	}
+	// every position of other is in this range
+	bool covers(const RingRange &other) const {
+		if ( start == end ) {
+			return true;
+		}
+		if ( other.start == other.end ) {
+			return false;
+		}
+		return (uint64_t)(other.start - start) <= (uint64_t)(other.end - start) &&
+			(uint64_t)(other.end - start) <= (uint64_t)(end - start);
+	}
+	// some position is in both ranges, the last one of them is the end of one of the two
+	bool overlaps(const RingRange &other) const {
+		return contains(other.end) || other.contains(end);
+	}
+};
+
+/**
+ * STRUCT NAME: RingTransfer
+ *
+ * DESCRIPTION: A range whose replica set differs between two rings
+ */
+struct RingTransfer {
+	RingRange range;
+	vector<Address> oldReplicas;
+	vector<Address> newReplicas;
+};
+
+/**
+ * CLASS NAME: RingSnapshot
+ *
+ * DESCRIPTION: Token positions of a ring and the replica set of the range ending at each
+ * 				token, enough to compare two rings after the ring itself has been replaced
+ */
+class RingSnapshot {
+public:
+	// sorted token positions
+	vector<uint64_t> pos;
+	// replicas of the range ending at each token, primary first
+	vector<vector<Address>> replicas;
+	// physical nodes present in the ring
+	vector<Address> nodes;
+	bool empty() const;
+	const vector<Address>& replicasAt(uint64_t p) const;
+	bool hasNode(const Address &addr) const;
+};
+
+/**
+ * CLASS NAME: RingDiff
+ *
+ * DESCRIPTION: Computes the exact ranges that changed owners between two rings
+ */
+class RingDiff {
+public:
+	static bool sameAddress(const Address &a, const Address &b);
+	static bool sameReplicas(const vector<Address> &a, const vector<Address> &b);
+	static vector<RingTransfer> diff(const RingSnapshot &oldRing, const RingSnapshot &newRing);
+	static const RingTransfer* find(const vector<RingTransfer> &transfers, uint64_t pos);
+};
+
+#endif /* RINGDIFF_H_ */
@@ -0,0 +1,154 @@
+/**********************************
+ * FILE NAME: SkipList.cpp
+ *
+ * DESCRIPTION: SkipList class definition
+ **********************************/
+
+#include "SkipList.h"
+
+/**
+ * constructor
+ */
+SkipList::SkipList(): level(1), nodes(0), payload(0), seed(0x9E3779B97F4A7C15ULL) {
+	head = newNode("", SKIPLIST_MAX_LEVEL);
+}
+
+SkipList::~SkipList() {
+	clear();
+	head->~Node();
+	free(head);
+}
+
+// newNode() an unlinked node with room for level forward pointers
+SkipList::Node *SkipList::newNode(string_view key, int level) {
+	void *mem = malloc(sizeof(Node) + (level - 1) * sizeof(Node *));
+	Node *node = new (mem) Node();
+	node->key.assign(key.data(), key.size());
+	node->tombstone = false;
+	node->level = level;
+	for ( int i = 0; i < level; i++ ) {
+		node->next[i] = nullptr;
+	}
+	return node;
+}
+
+// randomLevel() height of a new node, each level kept with probability 1/4 (xorshift)
+int SkipList::randomLevel() {
+	int height = 1;
+	while ( height < SKIPLIST_MAX_LEVEL ) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		if ( (seed & 3) != 0 ) {
+			break;
+		}
+		height++;
+	}
+	return height;
+}
+
+/**
+ * FUNCTION NAME: findGreaterOrEqual
+ *
+ * DESCRIPTION: First node whose key is not less than key, nullptr if none. When prev is
+ * 				given it receives the last node before key on every level.
+ */
+SkipList::Node *SkipList::findGreaterOrEqual(string_view key, Node **prev) const {
+	Node *node = head;
+	for ( int i = level - 1; i >= 0; i-- ) {
+		while ( node->next[i] && string_view(node->next[i]->key) < key ) {
+			node = node->next[i];
+		}
+		if ( prev ) {
+			prev[i] = node;
+		}
+	}
+	return node->next[0];
+}
+
+/**
+ * FUNCTION NAME: find
+ *
+ * DESCRIPTION: The node of key, a tombstone if the key was deleted
+ *
+ * RETURNS:
+ * nullptr if the list does not know the key
+ */
+const SkipList::Node *SkipList::find(string_view key) const {
+	Node *node = findGreaterOrEqual(key, nullptr);
+	return node && node->key == key ? node : nullptr;
+}
+
+/**
+ * FUNCTION NAME: put
+ *
+ * DESCRIPTION: Set the value of key, or mark it deleted when tombstone is set
+ */
+void SkipList::put(string_view key, string_view value, bool tombstone) {
+	Node *prev[SKIPLIST_MAX_LEVEL];
+	Node *node = findGreaterOrEqual(key, prev);
+	if ( node && node->key == key ) {
+		payload += value.size();
+		payload -= node->value.size();
+		node->value.assign(value.data(), value.size());
+		node->tombstone = tombstone;
+		return;
+	}
+	int height = randomLevel();
+	for ( int i = level; i < height; i++ ) {
+		prev[i] = head;
+	}
+	level = max(level, height);
+	node = newNode(key, height);
+	node->value.assign(value.data(), value.size());
+	node->tombstone = tombstone;
+	for ( int i = 0; i < height; i++ ) {
+		node->next[i] = prev[i]->next[i];
+		prev[i]->next[i] = node;
+	}
+	nodes++;
+	payload += key.size() + value.size() + sizeof(Node) + (height - 1) * sizeof(Node *);
+}
+
+/**
+ * FUNCTION NAME: seekAfter
+ *
+ * DESCRIPTION: First node whose key is greater than key, nullptr if none
+ */
+const SkipList::Node *SkipList::seekAfter(string_view key) const {
+	Node *node = findGreaterOrEqual(key, nullptr);
+	if ( node && node->key == key ) {
+		node = node->next[0];
+	}
+	return node;
+}
+
+/**
+ * FUNCTION NAME: bytes
+ *
+ * DESCRIPTION: Returns the bytes held by the nodes, keys and values
+ */
+size_t SkipList::bytes() const {
+	return payload + sizeof(Node) + (SKIPLIST_MAX_LEVEL - 1) * sizeof(Node *);
+}
+
+/**
+ * FUNCTION NAME: clear
+ *
+ * DESCRIPTION: Free every node
+ */
+void SkipList::clear() {
+	Node *node = head->next[0];
+	while ( node ) {
+		Node *next = node->next[0];
+		node->~Node();
+		free(node);
+		node = next;
+	}
+	for ( int i = 0; i < SKIPLIST_MAX_LEVEL; i++ ) {
+		head->next[i] = nullptr;
+	}
+	level = 1;
+	nodes = 0;
+	payload = 0;
+}
@@ -0,0 +1,66 @@
+/**********************************
+ * FILE NAME: SkipList.h
+ *
+ * DESCRIPTION: Header file SkipList class
+ **********************************/
+
+#ifndef SKIPLIST_H_
+#define SKIPLIST_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <string_view>
+
+/**
+ * Macros
+ */
+// levels of the tallest node, enough for 4^12 keys at one node in four per level
+#define SKIPLIST_MAX_LEVEL 12
+
+/**
+ * CLASS NAME: SkipList
+ *
+ * DESCRIPTION: Sorted in memory map of an LsmTable, the memtable. Every node holds a key, its
+ * 				value and whether the key was deleted (a tombstone, kept so the deletion hides
+ * 				older values of the key in the sorted runs). Nodes are only added or
+ * 				replaced in place until the whole list is cleared, so a node stays valid
+ * 				while the list is written to.
+ */
+class SkipList {
+public:
+	struct Node {
+		string key;
+		string value;
+		bool tombstone;
+		int level;
+		Node *next[1];
+	};
+
+private:
+	Node *head;
+	int level;
+	unsigned long nodes;
+	size_t payload;
+	uint64_t seed;
+
+	int randomLevel();
+	static Node *newNode(string_view key, int level);
+	Node *findGreaterOrEqual(string_view key, Node **prev) const;
+
+public:
+	SkipList();
+	SkipList(const SkipList &other) = delete;
+	SkipList &operator=(const SkipList &other) = delete;
+	const Node *find(string_view key) const;
+	void put(string_view key, string_view value, bool tombstone);
+	const Node *first() const { return head->next[0]; }
+	const Node *seekAfter(string_view key) const;
+	unsigned long size() const { return nodes; }
+	size_t bytes() const;
+	void clear();
+	virtual ~SkipList();
+};
+
+#endif /* SKIPLIST_H_ */
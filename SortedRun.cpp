@@ -0,0 +1,206 @@
+/**********************************
+ * FILE NAME: SortedRun.cpp
+ *
+ * DESCRIPTION: SortedRun class definition
+ **********************************/
+
+#include "SortedRun.h"
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: An empty run written to path, its filter sized for expectedKeys. Records
+ * 				are added in key order, then finish makes the run readable.
+ */
+SortedRun::SortedRun(const string &path, size_t expectedKeys): path(path), fd(-1), indexBytes(0), bloom(expectedKeys), fileSize(0), records(0) {
+	out = fopen(path.c_str(), "wb");
+}
+
+SortedRun::~SortedRun() {
+	if ( out ) {
+		fclose(out);
+	}
+	if ( fd >= 0 ) {
+		close(fd);
+	}
+	unlink(path.c_str());
+}
+
+/**
+ * FUNCTION NAME: add
+ *
+ * DESCRIPTION: Append a record, keys must come in increasing order
+ */
+void SortedRun::add(string_view key, string_view value, bool tombstone) {
+	if ( out == nullptr ) {
+		return;
+	}
+	if ( records % RUN_INDEX_INTERVAL == 0 ) {
+		index.emplace_back(string(key), fileSize);
+		indexBytes += key.size();
+	}
+	char head[RECORD_HEADER];
+	uint32_t keyLen = (uint32_t)key.size(), valueLen = (uint32_t)value.size();
+	memcpy(head, &keyLen, sizeof(keyLen));
+	memcpy(head + 4, &valueLen, sizeof(valueLen));
+	head[8] = tombstone ? 1 : 0;
+	fwrite(head, 1, RECORD_HEADER, out);
+	fwrite(key.data(), 1, key.size(), out);
+	fwrite(value.data(), 1, value.size(), out);
+	fileSize += RECORD_HEADER + key.size() + value.size();
+	records++;
+	bloom.add(key);
+}
+
+/**
+ * FUNCTION NAME: finish
+ *
+ * DESCRIPTION: Close the file for writing and open it for reads
+ *
+ * RETURNS:
+ * false if the file could not be written, the run must not be used then
+ */
+bool SortedRun::finish() {
+	if ( out == nullptr ) {
+		return false;
+	}
+	bool written = fflush(out) == 0 && !ferror(out);
+	fclose(out);
+	out = nullptr;
+	fd = open(path.c_str(), O_RDONLY);
+	return written && fd >= 0;
+}
+
+// blockOf() number of blocks whose first key is not greater than key
+size_t SortedRun::blockOf(string_view key) const {
+	return upper_bound(index.begin(), index.end(), key, [](string_view k, const pair<string, uint64_t> &entry) {
+		return k < string_view(entry.first);
+	}) - index.begin();
+}
+
+/**
+ * FUNCTION NAME: get
+ *
+ * DESCRIPTION: Look up key, reading at most one block from the file
+ *
+ * RETURNS:
+ * PRESENT with the stored value, DELETED if the run holds a tombstone for key, MISSING
+ */
+SortedRun::Lookup SortedRun::get(string_view key, string &value) const {
+	if ( fd < 0 || !bloom.mayContain(key) ) {
+		return MISSING;
+	}
+	size_t b = blockOf(key);
+	if ( b == 0 ) {
+		return MISSING;
+	}
+	b--;
+	uint64_t start = index[b].second;
+	uint64_t end = b + 1 < index.size() ? index[b + 1].second : fileSize;
+	block.resize(end - start);
+	if ( pread(fd, &block[0], block.size(), start) != (ssize_t)block.size() ) {
+		return MISSING;
+	}
+	size_t pos = 0;
+	while ( pos + RECORD_HEADER <= block.size() ) {
+		uint32_t keyLen, valueLen;
+		memcpy(&keyLen, &block[pos], sizeof(keyLen));
+		memcpy(&valueLen, &block[pos + 4], sizeof(valueLen));
+		string_view k(&block[pos + RECORD_HEADER], keyLen);
+		if ( k == key ) {
+			if ( block[pos + 8] ) {
+				return DELETED;
+			}
+			value.assign(&block[pos + RECORD_HEADER + keyLen], valueLen);
+			return PRESENT;
+		}
+		if ( k > key ) {
+			break;
+		}
+		pos += RECORD_HEADER + keyLen + valueLen;
+	}
+	return MISSING;
+}
+
+/**
+ * FUNCTION NAME: memoryUsed
+ *
+ * DESCRIPTION: Returns the bytes of the index and the filter, the records stay on disk
+ */
+size_t SortedRun::memoryUsed() const {
+	return index.capacity() * sizeof(pair<string, uint64_t>) + indexBytes + bloom.memoryUsed() + block.capacity();
+}
+
+// fill() makes bytes unread bytes available in the buffer, false at the end of the file
+bool SortedRun::Iterator::fill(size_t bytes) {
+	if ( pos + bytes <= buffer.size() ) {
+		return true;
+	}
+	offset += pos;
+	pos = 0;
+	if ( offset >= run->fileSize ) {
+		buffer.clear();
+		return false;
+	}
+	buffer.resize(min((uint64_t)max(bytes, (size_t)RUN_READ_BUFFER), run->fileSize - offset));
+	ssize_t got = pread(run->fd, &buffer[0], buffer.size(), offset);
+	buffer.resize(got < 0 ? 0 : got);
+	return bytes <= buffer.size();
+}
+
+// read() decodes the record at the current position
+void SortedRun::Iterator::read() {
+	valid = false;
+	if ( !fill(RECORD_HEADER) ) {
+		return;
+	}
+	uint32_t keyLen, valueLen;
+	memcpy(&keyLen, &buffer[pos], sizeof(keyLen));
+	memcpy(&valueLen, &buffer[pos + 4], sizeof(valueLen));
+	if ( !fill(RECORD_HEADER + keyLen + valueLen) ) {
+		return;
+	}
+	tombstone = buffer[pos + 8] != 0;
+	key = string_view(&buffer[pos + RECORD_HEADER], keyLen);
+	value = string_view(&buffer[pos + RECORD_HEADER + keyLen], valueLen);
+	valid = true;
+}
+
+/**
+ * FUNCTION NAME: seekFirst
+ *
+ * DESCRIPTION: Position the iterator on the first record of the run
+ */
+void SortedRun::Iterator::seekFirst() {
+	offset = 0;
+	pos = 0;
+	buffer.clear();
+	read();
+}
+
+/**
+ * FUNCTION NAME: seekAfter
+ *
+ * DESCRIPTION: Position the iterator on the first record whose key is greater than after,
+ * 				starting from the block that can hold after
+ */
+void SortedRun::Iterator::seekAfter(string_view after) {
+	size_t b = run->blockOf(after);
+	offset = b == 0 ? 0 : run->index[b - 1].second;
+	pos = 0;
+	buffer.clear();
+	read();
+	while ( valid && key <= after ) {
+		next();
+	}
+}
+
+/**
+ * FUNCTION NAME: next
+ *
+ * DESCRIPTION: Move to the following record, valid is cleared at the end of the run
+ */
+void SortedRun::Iterator::next() {
+	pos += RECORD_HEADER + key.size() + value.size();
+	read();
+}
@@ -0,0 +1,91 @@
+/**********************************
+ * FILE NAME: SortedRun.h
+ *
+ * DESCRIPTION: Header file SortedRun class
+ **********************************/
+
+#ifndef SORTEDRUN_H_
+#define SORTEDRUN_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include "BloomFilter.h"
+#include <string_view>
+
+/**
+ * Macros
+ */
+// directory holding the sorted runs of every LsmTable
+#define LSM_DIR "lsm"
+// records between two entries of the sparse index of a run
+#define RUN_INDEX_INTERVAL 16
+// bytes read at once by a run iterator
+#define RUN_READ_BUFFER 65536
+
+/**
+ * CLASS NAME: SortedRun
+ *
+ * DESCRIPTION: Immutable file of records sorted by key, written once by an LsmTable when it
+ * 				flushes its memtable or compacts runs. Every record is [u32 key length]
+ * 				[u32 value length][u8 tombstone][key][value]. Only a sparse index (the first
+ * 				key and offset of every block of RUN_INDEX_INTERVAL records) and a bloom
+ * 				filter of the keys are kept in memory: a lookup tests the filter, then reads
+ * 				the one block that can hold the key. The file is removed with the run.
+ */
+class SortedRun {
+public:
+	enum Lookup { MISSING, PRESENT, DELETED };
+
+	// sequential reader of a finished run, through a buffer of RUN_READ_BUFFER bytes.
+	// key and value are views into the buffer, valid until the next call.
+	class Iterator {
+		const SortedRun *run;
+		uint64_t offset;
+		string buffer;
+		size_t pos;
+		bool fill(size_t bytes);
+		void read();
+	public:
+		bool valid;
+		string_view key;
+		string_view value;
+		bool tombstone;
+		Iterator(const SortedRun *run = nullptr): run(run), offset(0), pos(0), valid(false), tombstone(false) {}
+		void seekFirst();
+		void seekAfter(string_view after);
+		void next();
+	};
+
+private:
+	static const size_t RECORD_HEADER = 9;
+
+	string path;
+	FILE *out;
+	int fd;
+	// first key and offset of every block
+	vector<pair<string, uint64_t>> index;
+	size_t indexBytes;
+	BloomFilter bloom;
+	uint64_t fileSize;
+	unsigned long records;
+	// block read by get
+	mutable string block;
+
+	size_t blockOf(string_view key) const;
+
+public:
+	SortedRun(const string &path, size_t expectedKeys);
+	SortedRun(const SortedRun &other) = delete;
+	SortedRun &operator=(const SortedRun &other) = delete;
+	void add(string_view key, string_view value, bool tombstone);
+	bool finish();
+	Lookup get(string_view key, string &value) const;
+	unsigned long size() const { return records; }
+	uint64_t bytes() const { return fileSize; }
+	size_t memoryUsed() const;
+	virtual ~SortedRun();
+};
+
+#endif /* SORTEDRUN_H_ */
@@ -0,0 +1,80 @@
+/**********************************
+ * FILE NAME: StorageEngine.h
+ *
+ * DESCRIPTION: Header file of the StorageEngine interface
+ **********************************/
+
+#ifndef STORAGEENGINE_H_
+#define STORAGEENGINE_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <functional>
+#include <string_view>
+
+/**
+ * Macros
+ */
+// kinds of StorageEngine, see STORAGE_ENGINE in Params.h
+#define HASH_ENGINE 0
+#define LSM_ENGINE 1
+
+/**
+ * STRUCT NAME: TableCursor
+ *
+ * DESCRIPTION: Position of a scan over a StorageEngine, kept by the caller between calls to
+ * 				next. Each engine uses the fields it needs: a hash table the next slot and
+ * 				its generation, an LSM table the last key returned. key and value hold the
+ * 				pair returned when the engine cannot hand out views into itself.
+ */
+struct TableCursor {
+	bool started;
+	size_t slot;
+	unsigned long generation;
+	string key;
+	string value;
+	TableCursor(): started(false), slot(0), generation(0) {}
+};
+
+/**
+ * CLASS NAME: StorageEngine
+ *
+ * DESCRIPTION: Interface of the key value table behind every partition of a RangeStore.
+ * 				Values are Entries in their encoded form and writes resolve last write wins,
+ * 				see Entry.h. The views returned by find and next are valid until the next
+ * 				call on the table.
+ */
+class StorageEngine {
+public:
+	// called after every change with the old and new value of the key, nullptr when absent
+	function<void(string_view key, const string_view *oldValue, const string_view *newValue)> onChange;
+
+	virtual bool find(string_view key, string_view &value) = 0;
+	virtual bool upsert(string_view key, string_view value) = 0;
+	// stores the value of a key already in the table, last write wins as upsert does, and only
+	// if accept(current value) holds when given. Returns whether the key is present.
+	virtual bool updateIfPresent(string_view key, string_view value, const function<bool(string_view current)> &accept = nullptr) = 0;
+	virtual bool eraseIfPresent(string_view key) = 0;
+	virtual bool isEmpty() = 0;
+	virtual unsigned long currentSize() = 0;
+	virtual void clear() = 0;
+	virtual size_t memoryUsed() const = 0;
+	// the next pair of a scan in the engine's own order, false once every key was returned.
+	// A key changed during a scan may be returned twice, never skipped.
+	virtual bool next(TableCursor &cursor, string_view &key, string_view &value) = 0;
+	// a slice of background work, called once per tick
+	virtual void tick() {}
+	// calls f(key, value) for every key
+	template <typename F> void forEach(F f) {
+		TableCursor cursor;
+		string_view key, value;
+		while ( next(cursor, key, value) ) {
+			f(key, value);
+		}
+	}
+	virtual ~StorageEngine() {}
+};
+
+#endif /* STORAGEENGINE_H_ */
@@ -0,0 +1,72 @@
+/**********************************
+ * FILE NAME: TimerWheel.cpp
+ *
+ * DESCRIPTION: TimerWheel class definition
+ **********************************/
+
+#include "TimerWheel.h"
+
+/**
+ * constructor
+ *
+ * DESCRIPTION: An empty wheel whose clock is at now
+ */
+TimerWheel::TimerWheel(uint64_t now): current(now), pending(0) {}
+
+// place() puts a timer in the slot of the lowest level whose span reaches its due tick
+void TimerWheel::place(Timer &&timer) {
+	uint64_t delta = timer.due - current;
+	for ( int level = 0; level < WHEEL_LEVELS; level++ ) {
+		if ( delta < (1ULL << (WHEEL_BITS * (level + 1))) ) {
+			slots[level][(timer.due >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)].push_back(move(timer));
+			return;
+		}
+	}
+	overflow.push_back(move(timer));
+}
+
+// cascade() spreads the timers of a slot the clock just entered over the lower levels
+void TimerWheel::cascade(vector<Timer> &slot) {
+	vector<Timer> timers;
+	timers.swap(slot);
+	for ( auto &timer : timers ) {
+		place(move(timer));
+	}
+}
+
+/**
+ * FUNCTION NAME: schedule
+ *
+ * DESCRIPTION: Fire key at tick when, or at the next tick if when is not in the future
+ */
+void TimerWheel::schedule(const string &key, uint64_t when) {
+	place(Timer{key, when, max(when, current + 1)});
+	pending++;
+}
+
+/**
+ * FUNCTION NAME: advance
+ *
+ * DESCRIPTION: Move the clock to now, appending the (key, when) of every timer due on the
+ * 				way to fired
+ */
+void TimerWheel::advance(uint64_t now, vector<pair<string, uint64_t>> &fired) {
+	while ( current < now ) {
+		current++;
+		for ( int level = 1; level < WHEEL_LEVELS; level++ ) {
+			if ( current & ((1ULL << (WHEEL_BITS * level)) - 1) ) {
+				break;
+			}
+			cascade(slots[level][(current >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)]);
+		}
+		if ( (current & ((1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) == 0 ) {
+			cascade(overflow);
+		}
+		vector<Timer> &slot = slots[0][current & (WHEEL_SLOTS - 1)];
+		for ( auto &timer : slot ) {
+			fired.emplace_back(move(timer.key), timer.when);
+		}
+		pending -= slot.size();
+		slot.clear();
+	}
+}
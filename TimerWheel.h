@@ -0,0 +1,58 @@
+/**********************************
+ * FILE NAME: TimerWheel.h
+ *
+ * DESCRIPTION: Header file TimerWheel class
+ **********************************/
+
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+/**
+ * Header files
+ */
+#include "stdincludes.h"
+#include <stdint.h>
+
+/**
+ * Macros
+ */
+// every level of the wheel has 2^WHEEL_BITS slots, each a tick of the level below wide
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+// the levels cover 2^(WHEEL_BITS * WHEEL_LEVELS) ticks ahead, later timers wait in an overflow list
+#define WHEEL_LEVELS 4
+
+/**
+ * CLASS NAME: TimerWheel
+ *
+ * DESCRIPTION: Hierarchical timer wheel of keys due at a tick. Level 0 has a slot per tick,
+ * 				a slot of level l spans WHEEL_SLOTS slots of level l - 1. A timer goes to the
+ * 				lowest level whose span reaches its tick; when the clock enters a slot of
+ * 				level l its timers are spread over the levels below, so every timer is
+ * 				moved at most WHEEL_LEVELS times and no timer is looked at before it is due.
+ * 				Timers cannot be cancelled: the owner checks a fired timer is still current.
+ */
+class TimerWheel {
+	struct Timer {
+		string key;
+		// tick the key expires at, and tick the timer fires at, never in the past
+		uint64_t when;
+		uint64_t due;
+	};
+
+	vector<Timer> slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	vector<Timer> overflow;
+	uint64_t current;
+	size_t pending;
+
+	void place(Timer &&timer);
+	void cascade(vector<Timer> &slot);
+
+public:
+	TimerWheel(uint64_t now = 0);
+	void schedule(const string &key, uint64_t when);
+	void advance(uint64_t now, vector<pair<string, uint64_t>> &fired);
+	size_t size() const { return pending; }
+};
+
+#endif /* TIMERWHEEL_H_ */
@@ -4,11 +4,13 @@
 /**
  * Global variable
  */
-// Transaction Id
-static int g_transID = 0;
+// Transaction Id, only used by the translation units that send messages
+[[maybe_unused]] static int g_transID = 0;
 
-// message types, reply is the message from node to coordinator
-enum MessageType {CREATE, READ, UPDATE, DELETE, REPLY, READREPLY};
+// message types, reply is the message from node to coordinator, transfer carries a batch of
+// key value pairs moved by the stabilization protocol, merkle carries hash tree nodes
+// exchanged by anti-entropy, image carries a chunk of the image of a range sent whole
+enum MessageType {CREATE, READ, UPDATE, DELETE, REPLY, READREPLY, TRANSFER, MERKLE, IMAGE};
 // enum of replica types
 enum ReplicaType {PRIMARY, SECONDARY, TERTIARY};
 
@@ -10,7 +10,7 @@
 /*
  * Macros
  */
-#define RING_SIZE 512
+#define MAX_REPLICAS 8
 #define FAILURE -1
 #define SUCCESS 0
 